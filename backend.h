@@ -0,0 +1,71 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#pragma once
+
+#include "bool.h"
+
+struct pollfd;
+struct ip6;
+
+enum probeStatus {
+    PROBE_OPEN,
+    PROBE_CLOSED,
+    PROBE_TIMEOUT,
+    PROBE_ERROR,
+
+    /* The probe wasn't sent for lack of descriptors and may be submitted again later */
+    PROBE_RETRY
+};
+
+struct probe {
+    unsigned int tag;
+    unsigned int ip;
+    unsigned short port;
+    enum probeStatus status;
+};
+
+/* Probe backend: the engine submits at most maxInFlight probes tagged by
+   0 <= tag < maxInFlight and collects them as completions. */
+struct backend {
+    const char * name;
+
+    /* Returns the number of probes the backend can keep in flight, at most maxInFlight */
+    unsigned int (* init)(unsigned int maxInFlight);
+    void (* submit)(unsigned int tag, unsigned int ip, unsigned short port, unsigned int timeout);
+
+    /* Waits up to timeout ms for completions and extra descriptors, returns -1 if interrupted */
+    int (* poll)(struct pollfd * extra, unsigned int extraLen, int timeout, struct probe * done, unsigned int * doneLen);
+
+    /* Backend clock, ms */
+    long long (* now)(void);
+
+    /* Prints backend statistics, may be NULL */
+    void (* report)(void);
+
+    /* Submits a probe of an IPv6 address, completions have ip 0; NULL if not supported */
+    void (* submit6)(unsigned int tag, const struct ip6 * ip, unsigned short port, unsigned int timeout);
+};
+
+extern const struct backend socketBackend;
+extern const struct backend simBackend;
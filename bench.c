@@ -0,0 +1,168 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+
+#include "targets.h"
+#include "global.h"
+#include "util.h"
+
+static double now(void) {
+    static struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static unsigned int xorshift(void) {
+    static unsigned int state = 2463534242u;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+static unsigned int legacyStrToNum(const char * ip) {
+    static unsigned int ret[4];
+
+    sscanf(ip, "%3u.%3u.%3u.%3u",
+        & ret[0],
+        & ret[1],
+        & ret[2],
+        & ret[3]
+    );
+
+    ret[0] <<= 24;
+    ret[1] <<= 16;
+    ret[2] <<= 8;
+
+    return ret[0] + ret[1] + ret[2] + ret[3];
+}
+
+static void report(const char * name, double time, size_t count, size_t bytes, unsigned int sum) {
+    printf("%-24s %8.3f s %8.1f ns/op", name, time, time * 1e9 / count);
+
+    if (bytes > 0) {
+        printf(" %8.1f MB/s", bytes / time / 1e6);
+    }
+
+    printf("  (%08x)\n", sum);
+}
+
+int main(int argc, char ** argv) {
+    size_t count = 10000000;
+
+    if (argc > 1) {
+        sscanf(argv[1], "%zu", & count);
+    }
+
+    char * data = malloc(count * 16 + 1);
+    if (data == NULL) {
+        perror("ERROR (malloc)");
+        return 1;
+    }
+
+    unsigned int * ips = malloc(count * sizeof(unsigned int));
+    if (ips == NULL) {
+        perror("ERROR (malloc)");
+        return 1;
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < count; ++i) {
+        ips[i] = xorshift();
+
+        len += ipNumToStr(ips[i], data + len);
+        data[len++] = '\n';
+    }
+
+    data[len] = '\0';
+
+    unsigned int sum = 0;
+    double start = now();
+
+    static char line[32];
+
+    for (const char * ptr = data; * ptr != '\0'; ) {
+        const char * eol = strchr(ptr, '\n');
+
+        memcpy(line, ptr, eol - ptr);
+        line[eol - ptr] = '\0';
+
+        sum += legacyStrToNum(line);
+        ptr = eol + 1;
+    }
+
+    report("parse (sscanf)", now() - start, count, len, sum);
+
+    sum = 0;
+    start = now();
+
+    static struct targets targets;
+    static unsigned int range[2];
+
+    targetsInit(& targets, data, len);
+    while (targetsNext(& targets, range)) {
+        sum += range[0];
+    }
+
+    report("parse (targets)", now() - start, count, len, sum);
+
+    static char strIP[16];
+
+    sum = 0;
+    start = now();
+
+    for (size_t i = 0; i < count; ++i) {
+        unsigned int ip = ips[i];
+
+        sum += sprintf(strIP, "%u.%u.%u.%u",
+            (ip >> 24) & 0xff,
+            (ip >> 16) & 0xff,
+            (ip >> 8) & 0xff,
+            ip & 0xff
+        );
+        sum += strIP[sum & 7];
+    }
+
+    report("format (sprintf)", now() - start, count, 0, sum);
+
+    sum = 0;
+    start = now();
+
+    for (size_t i = 0; i < count; ++i) {
+        sum += ipNumToStr(ips[i], strIP);
+        sum += strIP[sum & 7];
+    }
+
+    report("format (ipNumToStr)", now() - start, count, 0, sum);
+
+    free(ips);
+    free(data);
+
+    return 0;
+}
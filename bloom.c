@@ -0,0 +1,66 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#include "bloom.h"
+
+#include "global.h"
+
+void bloomInit(struct bloom * bloom, unsigned long long count, unsigned int bitsPerItem) {
+    bloom->size = (count > 0 ? count : 1) * bitsPerItem;
+    bloom->size = (bloom->size + 63) & ~63ull;
+
+    /* k = ln 2 * m / n minimizes false positives */
+    bloom->hashes = (unsigned int) (bitsPerItem * 0.693 + 0.5);
+    if (bloom->hashes == 0) {
+        bloom->hashes = 1;
+    }
+
+    bloom->bits = calloc(bloom->size / 64, sizeof(unsigned long long));
+    if (bloom->bits == NULL) {
+        __error("calloc");
+    }
+}
+
+void bloomFree(struct bloom * bloom) {
+    free(bloom->bits);
+    bloom->bits = NULL;
+}
+
+bool bloomAdd(struct bloom * bloom, unsigned long long h1, unsigned long long h2) {
+    bool present = true;
+
+    /* Double hashing, h2 is made nonzero to spread the bits */
+    h2 |= 1;
+
+    for (unsigned int i = 0; i < bloom->hashes; ++i) {
+        unsigned long long bit = (h1 + i * h2) % bloom->size;
+        unsigned long long mask = 1ull << (bit & 63);
+
+        if (!(bloom->bits[bit >> 6] & mask)) {
+            bloom->bits[bit >> 6] |= mask;
+            present = false;
+        }
+    }
+
+    return present;
+}
@@ -0,0 +1,601 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "daemon.h"
+
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <poll.h>
+
+#include "platform.h"
+
+#include "ratelimit.h"
+#include "options.h"
+#include "resolve.h"
+#include "engine.h"
+#include "global.h"
+#include "main.h"
+#include "util.h"
+
+#define MAX_JOB_LINE (1 << 20)
+
+/* Job of a client is paused while this much output waits for it */
+#define MAX_CLIENT_OUT (1 << 20)
+
+/* Accepting pauses this long once descriptors run out, the listener would stay readable meanwhile */
+#define ACCEPT_RETRY_DELAY 1000
+
+struct client {
+    int fd;
+
+    char * in;
+    size_t inLen, inCap;
+
+    char * out;
+    size_t outLen, outCap;
+
+    struct job * job;
+    bool done;
+};
+
+static struct client ** clients = NULL;
+static unsigned int clientsLen = 0, clientsCap = 0;
+
+static volatile sig_atomic_t running;
+
+static long long acceptRetryAt = 0;
+
+static void stopDaemon(int sig) {
+    running = 0;
+}
+
+static void reserve(char ** buf, size_t * cap, size_t len) {
+    if (* cap >= len) {
+        return;
+    }
+
+    * cap = * cap * 2 > len ? * cap * 2 : len;
+
+    * buf = realloc(* buf, * cap);
+    if (* buf == NULL) {
+        __error("realloc");
+    }
+}
+
+static void clientPrint(struct client * client, const char * str) {
+    size_t len = strlen(str);
+
+    reserve(& client->out, & client->outCap, client->outLen + len);
+    memcpy(client->out + client->outLen, str, len);
+    client->outLen += len;
+
+    if (client->job != NULL && client->outLen >= MAX_CLIENT_OUT) {
+        client->job->paused = true;
+    }
+}
+
+static void freeJob(struct job * job) {
+    free(job->ports);
+    free(job);
+}
+
+static void jobHit(struct job * job, unsigned int ip, unsigned short port) {
+    if (job->data == NULL) {
+        return;
+    }
+
+    static char strIP[16], line[32];
+    ipNumToStr(ip, strIP);
+    snprintf(line, sizeof(line), "HIT %s %hu\n", strIP, port);
+
+    clientPrint(job->data, line);
+}
+
+static void jobBoo(struct job * job, unsigned int ip) {
+    if (job->data == NULL) {
+        return;
+    }
+
+    static char strIP[16], line[32];
+    ipNumToStr(ip, strIP);
+    snprintf(line, sizeof(line), "BOO %s\n", strIP);
+
+    clientPrint(job->data, line);
+}
+
+static void jobDone(struct job * job) {
+    struct client * client = job->data;
+
+    if (client != NULL) {
+        clientPrint(client, "DONE\n");
+
+        client->job = NULL;
+        client->done = true;
+    }
+
+    freeJob(job);
+}
+
+static struct job * parseJob(char * line) {
+    static unsigned short ports[65535];
+    static char begin[16], end[16];
+    unsigned int ipRange[2], delay, priority, boo;
+    int n;
+
+    if (sscanf(line, "SCAN %15s %15s %u %u %u%n", begin, end, & delay, & priority, & boo, & n) != 5 || delay > MAX_DELAY) {
+        return NULL;
+    }
+
+    if (
+        ipParse(begin, begin + strlen(begin), & ipRange[0]) != begin + strlen(begin) ||
+        ipParse(end, end + strlen(end), & ipRange[1]) != end + strlen(end)
+    ) {
+        return NULL;
+    }
+
+    unsigned short portsLen = 0;
+    char * ptr = line + n, * endPtr;
+
+    for (;;) {
+        unsigned long port = strtoul(ptr, & endPtr, 10);
+
+        if (endPtr == ptr) {
+            break;
+        }
+
+        if (port == 0 || port > 65535 || portsLen == 65535) {
+            return NULL;
+        }
+
+        ports[portsLen++] = port;
+        ptr = endPtr;
+    }
+
+    if (* ptr != '\0' && * ptr != '\r') {
+        return NULL;
+    }
+
+    struct job * job = calloc(1, sizeof(struct job));
+    if (job == NULL) {
+        __error("calloc");
+    }
+
+    job->ports = malloc(portsLen * sizeof(unsigned short) + 1);
+    if (job->ports == NULL) {
+        __error("malloc");
+    }
+
+    memcpy(job->ports, ports, portsLen * sizeof(unsigned short));
+    job->portsLen = portsLen;
+
+    targetsRange(& job->targets, ipRange[0], ipRange[1]);
+    job->delay = delay;
+    job->priority = priority < 1 ? 1 : priority > MAX_PRIORITY ? MAX_PRIORITY : priority;
+    job->retries = options.retries;
+    job->learnPorts = options.portOrder == PORT_ORDER_LEARNED;
+
+    job->onHit = jobHit;
+    job->onBoo = boo ? jobBoo : NULL;
+    job->onDone = jobDone;
+
+    return job;
+}
+
+static void acceptClients(int listener) {
+    for (;;) {
+        int fd = accept(listener, NULL, NULL);
+
+        if (fd == -1) {
+            if (errno == EMFILE || errno == ENFILE) {
+                perror("ERROR (accept)");
+                acceptRetryAt = nowMs() + ACCEPT_RETRY_DELAY;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK && options.debug) {
+                perror("ERROR (accept)");
+            }
+
+            return;
+        }
+
+        if (setSocketNonBlock(fd) == -1) {
+            __error("setSocketNonBlock");
+        }
+
+        struct client * client = calloc(1, sizeof(struct client));
+        if (client == NULL) {
+            __error("calloc");
+        }
+
+        client->fd = fd;
+
+        if (clientsLen == clientsCap) {
+            clientsCap = clientsCap == 0 ? 16 : clientsCap * 2;
+
+            clients = realloc(clients, clientsCap * sizeof(struct client *));
+            if (clients == NULL) {
+                __error("realloc");
+            }
+        }
+
+        clients[clientsLen++] = client;
+    }
+}
+
+static void dropClient(unsigned int i) {
+    struct client * client = clients[i];
+
+    if (client->job != NULL) {
+        client->job->data = NULL;
+        engineCancelJob(client->job);
+    }
+
+    if (close(client->fd) == -1) {
+        __error("close");
+    }
+
+    free(client->in);
+    free(client->out);
+    free(client);
+
+    clients[i] = clients[--clientsLen];
+
+    /* Its descriptor is free for a waiting client */
+    acceptRetryAt = 0;
+}
+
+static bool readClient(struct client * client) {
+    for (;;) {
+        reserve(& client->in, & client->inCap, client->inLen + 4096);
+
+        ssize_t r = read(client->fd, client->in + client->inLen, 4096);
+
+        if (r == 0) {
+            return false;
+        }
+
+        if (r == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        if (client->job != NULL || client->done) {
+            continue;
+        }
+
+        client->inLen += r;
+
+        char * eol = memchr(client->in, '\n', client->inLen);
+
+        if (eol == NULL) {
+            if (client->inLen > MAX_JOB_LINE) {
+                clientPrint(client, "ERROR Job is too long\n");
+                client->done = true;
+            }
+
+            continue;
+        }
+
+        * eol = '\0';
+
+        client->job = parseJob(client->in);
+        client->inLen = 0;
+
+        if (client->job == NULL) {
+            clientPrint(client, "ERROR Malformed job\n");
+            client->done = true;
+            continue;
+        }
+
+        client->job->data = client;
+        engineAddJob(client->job);
+    }
+}
+
+static bool writeClient(struct client * client) {
+    while (client->outLen > 0) {
+        ssize_t w = write(client->fd, client->out, client->outLen);
+
+        if (w == -1) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        memmove(client->out, client->out + w, client->outLen - w);
+        client->outLen -= w;
+    }
+
+    return true;
+}
+
+int runDaemon(const char * path) {
+    static struct sockaddr_un sockAddr;
+    memset(& sockAddr, 0, sizeof(sockAddr));
+
+    if (strlen(path) >= sizeof(sockAddr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path is too long\n");
+        return 1;
+    }
+
+    sockAddr.sun_family = AF_UNIX;
+    strcpy(sockAddr.sun_path, path);
+
+    /* A socket left by a dead daemon is replaced, a live one is kept */
+    static struct stat st;
+    if (stat(path, & st) == 0 && S_ISSOCK(st.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (probe == -1) {
+            __error("socket");
+        }
+
+        bool live = connect(probe, (struct sockaddr *) & sockAddr, sizeof(sockAddr)) == 0;
+        close(probe);
+
+        if (live) {
+            fprintf(stderr, "ERROR: Daemon is already running on %s\n", path);
+            return 1;
+        }
+
+        unlink(path);
+    }
+
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener == -1) {
+        __error("socket");
+    }
+
+    if (bind(listener, (struct sockaddr *) & sockAddr, sizeof(sockAddr)) == -1) {
+        __error("bind");
+    }
+
+    if (listen(listener, SOMAXCONN) == -1) {
+        __error("listen");
+    }
+
+    if (setSocketNonBlock(listener) == -1) {
+        __error("setSocketNonBlock");
+    }
+
+    static struct sigaction action;
+    memset(& action, 0, sizeof(action));
+
+    action.sa_handler = stopDaemon;
+    sigaction(SIGINT, & action, NULL);
+    sigaction(SIGTERM, & action, NULL);
+
+    action.sa_handler = SIG_IGN;
+    sigaction(SIGPIPE, & action, NULL);
+
+    engineInit(options.concurrency, options.rate, findBackend(options.backend));
+
+    struct pollfd * fds = NULL;
+    unsigned int fdsCap = 0;
+
+    running = 1;
+    while (running) {
+        if (fdsCap < clientsLen + 1) {
+            fdsCap = clientsCap + 1;
+
+            fds = realloc(fds, fdsCap * sizeof(struct pollfd));
+            if (fds == NULL) {
+                __error("realloc");
+            }
+        }
+
+        fds[0].fd = listener;
+        fds[0].events = POLLIN;
+
+        int timeout = -1;
+
+        if (acceptRetryAt != 0) {
+            long long now = nowMs();
+
+            if (now < acceptRetryAt) {
+                fds[0].events = 0;
+                timeout = acceptRetryAt - now;
+            } else {
+                acceptRetryAt = 0;
+            }
+        }
+
+        for (unsigned int i = 0; i < clientsLen; ++i) {
+            fds[i + 1].fd = clients[i]->fd;
+            fds[i + 1].events = POLLIN | (clients[i]->outLen > 0 ? POLLOUT : 0);
+        }
+
+        unsigned int fdsLen = clientsLen + 1;
+        if (engineRun(fds, fdsLen, timeout) == -1) {
+            continue;
+        }
+
+        for (unsigned int i = fdsLen - 1; i > 0; --i) {
+            struct client * client = clients[i - 1];
+
+            bool ok = true;
+            if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                ok = readClient(client);
+            }
+
+            if (ok) {
+                ok = writeClient(client);
+            }
+
+            if (client->job != NULL) {
+                client->job->paused = client->outLen >= MAX_CLIENT_OUT;
+            }
+
+            if (!ok || (client->done && client->outLen == 0)) {
+                dropClient(i - 1);
+            }
+        }
+
+        if (fds[0].revents & POLLIN) {
+            acceptClients(listener);
+        }
+    }
+
+    while (clientsLen > 0) {
+        dropClient(clientsLen - 1);
+    }
+
+    /* Cancelled jobs are freed once their probes in flight are back */
+    while (!engineIdle()) {
+        engineRun(NULL, 0, -1);
+    }
+
+    free(fds);
+    close(listener);
+    unlink(path);
+
+    return 0;
+}
+
+/* Handles a line of the daemon, returns the exit code once the job is over or -1 */
+static int clientLine(const char * line) {
+    static char strIP[16];
+    unsigned short port;
+
+    if (sscanf(line, "HIT %15s %hu", strIP, & port) == 2) {
+        printHit(ipStrToNum(strIP), port);
+    } else if (sscanf(line, "BOO %15s", strIP) == 1) {
+        printBoo(ipStrToNum(strIP));
+    } else if (strncmp(line, "DONE", 4) == 0) {
+        return 0;
+    } else if (strncmp(line, "ERROR ", 6) == 0) {
+        fprintf(stderr, "ERROR (daemon): %s\n", line + 6);
+        return 1;
+    }
+
+    return -1;
+}
+
+int runClient(const char * path) {
+    static struct sockaddr_un sockAddr;
+    memset(& sockAddr, 0, sizeof(sockAddr));
+
+    if (strlen(path) >= sizeof(sockAddr.sun_path)) {
+        fprintf(stderr, "ERROR: Socket path is too long\n");
+        return 1;
+    }
+
+    sockAddr.sun_family = AF_UNIX;
+    strcpy(sockAddr.sun_path, path);
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock == -1) {
+        __error("socket");
+    }
+
+    if (connect(sock, (struct sockaddr *) & sockAddr, sizeof(sockAddr)) == -1) {
+        __error("connect");
+    }
+
+    FILE * stream = fdopen(sock, "r+");
+    if (stream == NULL) {
+        __error("fdopen");
+    }
+
+    static char begin[16], end[16];
+    ipNumToStr(options.ipRange[0], begin);
+    ipNumToStr(options.ipRange[1], end);
+
+    fprintf(stream, "SCAN %s %s %u %u %u", begin, end, options.delay, options.priority, options.printBoo);
+    for (unsigned int i = 0; i < options.portsLen; ++i) {
+        fprintf(stream, " %hu", options.ports[i]);
+    }
+
+    fputc('\n', stream);
+    if (fflush(stream) == EOF) {
+        __error("fflush");
+    }
+
+    /* Replies are read along with the resolver, so names of hits aren't held up by a quiet daemon */
+    static char buffer[4096];
+    size_t bufferLen = 0;
+
+    for (;;) {
+        struct pollfd fds[2] = { { sock, POLLIN, 0 }, { -1, POLLIN, 0 } };
+        int timeout = -1;
+
+        if (options.resolve != NULL) {
+            fds[1].fd = resolveFd(& timeout);
+        }
+
+        if (poll(fds, 2, timeout) == -1 && errno != EINTR) {
+            __error("poll");
+        }
+
+        if (options.resolve != NULL) {
+            resolvePoll();
+        }
+
+        if (fds[0].revents == 0) {
+            continue;
+        }
+
+        ssize_t r = read(sock, buffer + bufferLen, sizeof(buffer) - bufferLen);
+
+        if (r == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+
+            __error("read");
+        }
+
+        if (r == 0) {
+            break;
+        }
+
+        bufferLen += r;
+
+        char * line = buffer, * eol;
+        while ((eol = memchr(line, '\n', buffer + bufferLen - line)) != NULL) {
+            * eol = '\0';
+
+            int ret = clientLine(line);
+            if (ret != -1) {
+                fclose(stream);
+                return ret;
+            }
+
+            line = eol + 1;
+        }
+
+        bufferLen -= line - buffer;
+        memmove(buffer, line, bufferLen);
+
+        /* Overlong lines aren't sent by the daemon, drop one instead of stalling */
+        if (bufferLen == sizeof(buffer)) {
+            bufferLen = 0;
+        }
+    }
+
+    fprintf(stderr, "ERROR (daemon): Connection closed\n");
+    fclose(stream);
+
+    return 1;
+}
+
+#endif
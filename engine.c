@@ -0,0 +1,649 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "engine.h"
+
+#include <poll.h>
+
+#include "platform.h"
+
+#include "ratelimit.h"
+#include "options.h"
+#include "global.h"
+#include "util.h"
+
+/* Wait before probes put back for lack of descriptors are submitted again, ms */
+#define ENGINE_RETRY_DELAY 10
+
+/* Order of the job ports, shared with the slots which started probing a host in it */
+struct portSequence {
+    unsigned int refs;
+    unsigned short idx[];
+};
+
+struct slot {
+    struct job * job;
+    struct portSequence * order;
+    struct ip6 ip6;
+
+    /* Address of an IPv4 host, cap key of an IPv6 one */
+    unsigned int ip;
+    unsigned int block;
+
+    unsigned short portIdx;
+    unsigned short attempt;
+    bool hit;
+    bool answered;
+    long long start;
+};
+
+static const struct backend * backend = NULL;
+
+static struct slot * slots = NULL;
+static unsigned int slotsLen = 0;
+
+/* Stacks of free slots and of slots waiting to probe their next port */
+static unsigned int * freeSlots = NULL, * pendingSlots = NULL;
+static unsigned int freeLen = 0, pendingLen = 0;
+
+/* Probes allowed in flight, lowered when the backend runs out of descriptors
+   and raised again by one after as many completed probes */
+static unsigned int slotsLimit = 0, slotsGrowth = 0;
+static long long retryAt = 0;
+
+static struct probe * done = NULL;
+
+static struct job * jobs = NULL;
+static struct job * current = NULL;
+static unsigned int jobsLen = 0;
+
+static struct rateLimit limit;
+
+/* Counts of probes in flight per host and per block, entries with zero count are free */
+struct capEntry {
+    unsigned int key;
+    unsigned int count;
+};
+
+struct capTable {
+    struct capEntry * entries;
+    unsigned int mask;
+    unsigned int max;
+};
+
+static struct capTable hostCaps, blockCaps;
+static unsigned int blockShift;
+
+const struct backend * findBackend(const char * name) {
+    static const struct backend * backends[] = { & socketBackend, & simBackend };
+
+    for (unsigned int i = 0; i < sizeof(backends) / sizeof(backends[0]); ++i) {
+        if (strcmp(backends[i]->name, name) == 0) {
+            return backends[i];
+        }
+    }
+
+    return NULL;
+}
+
+static struct portSequence * newOrder(unsigned short len) {
+    struct portSequence * order = malloc(sizeof(struct portSequence) + len * sizeof(unsigned short));
+    if (order == NULL) {
+        __error("malloc");
+    }
+
+    order->refs = 1;
+    return order;
+}
+
+static void releaseOrder(struct portSequence * order) {
+    if (--order->refs == 0) {
+        free(order);
+    }
+}
+
+/* Moves the port ahead of the ports with less hits, slots probing a host keep their order */
+static void learnPort(struct job * job, unsigned short idx) {
+    unsigned int hits = ++job->portHits[idx];
+    unsigned short pos = job->portPos[idx];
+    struct portSequence * order = job->order;
+
+    if (pos == 0 || job->portHits[order->idx[pos - 1]] >= hits) {
+        return;
+    }
+
+    if (order->refs > 1) {
+        job->order = newOrder(job->portsLen);
+        memcpy(job->order->idx, order->idx, job->portsLen * sizeof(unsigned short));
+
+        releaseOrder(order);
+        order = job->order;
+    }
+
+    for (; pos > 0 && job->portHits[order->idx[pos - 1]] < hits; --pos) {
+        order->idx[pos] = order->idx[pos - 1];
+        job->portPos[order->idx[pos]] = pos;
+    }
+
+    order->idx[pos] = idx;
+    job->portPos[idx] = pos;
+}
+
+static unsigned short slotPort(struct slot * slot) {
+    return slot->job->ports[slot->order->idx[slot->portIdx]];
+}
+
+static unsigned int hashCap(struct capTable * table, unsigned int key) {
+    return (key * 2654435761u) & table->mask;
+}
+
+static unsigned int capHome(const void * entry, void * table) {
+    const struct capEntry * cap = entry;
+
+    return cap->count > 0 ? hashCap(table, cap->key) : TABLE_EMPTY;
+}
+
+static struct capEntry * capFind(struct capTable * table, unsigned int key) {
+    unsigned int i = hashCap(table, key);
+
+    while (table->entries[i].count > 0 && table->entries[i].key != key) {
+        i = (i + 1) & table->mask;
+    }
+
+    return & table->entries[i];
+}
+
+static void capInit(struct capTable * table, unsigned int max) {
+    unsigned int size = 2;
+    while (size < slotsLen * 2) {
+        size *= 2;
+    }
+
+    table->max = max;
+    table->mask = size - 1;
+
+    if (max > 0) {
+        table->entries = calloc(size, sizeof(struct capEntry));
+
+        if (table->entries == NULL) {
+            __error("calloc");
+        }
+    }
+}
+
+static bool capAdmit(struct capTable * table, unsigned int key) {
+    return table->max == 0 || capFind(table, key)->count < table->max;
+}
+
+static void capAcquire(struct capTable * table, unsigned int key) {
+    if (table->max == 0) {
+        return;
+    }
+
+    struct capEntry * entry = capFind(table, key);
+
+    entry->key = key;
+    ++entry->count;
+}
+
+static void capRelease(struct capTable * table, unsigned int key) {
+    if (table->max == 0) {
+        return;
+    }
+
+    struct capEntry * entry = capFind(table, key);
+    if (--entry->count > 0) {
+        return;
+    }
+
+    tableRemoveAt(table->entries, sizeof(struct capEntry), table->mask, entry - table->entries, capHome, table);
+}
+
+static unsigned int blockOf(unsigned int ip) {
+    return blockShift < 32 ? ip >> blockShift : 0;
+}
+
+static bool admitIP(unsigned int ip) {
+    return capAdmit(& hostCaps, ip) && capAdmit(& blockCaps, blockOf(ip));
+}
+
+static unsigned int hostKey6(const struct ip6 * ip) {
+    return (unsigned int) mix64(ip->hi ^ mix64(ip->lo));
+}
+
+static unsigned int blockKey6(const struct ip6 * ip) {
+    return (unsigned int) mix64(ip->hi);
+}
+
+/* IPv6 addresses are taken in hitlist order, caps are rejected for IPv6 scans since one address
+   at its cap would hold the job back until they are released */
+static bool jobNextIP6(struct job * job, struct slot * slot) {
+    if (!job->hasLookahead6 && job->more6) {
+        job->more6 = job->next6(job, & job->lookahead6);
+        job->hasLookahead6 = job->more6;
+    }
+
+    if (!job->hasLookahead6) {
+        return false;
+    }
+
+    unsigned int host = hostKey6(& job->lookahead6), block = blockKey6(& job->lookahead6);
+
+    if (!capAdmit(& hostCaps, host) || !capAdmit(& blockCaps, block)) {
+        return false;
+    }
+
+    job->hasLookahead6 = false;
+
+    slot->ip6 = job->lookahead6;
+    slot->ip = host;
+    slot->block = block;
+    return true;
+}
+
+/* Addresses of blocks waiting for their results or at their caps become available later */
+static bool jobNextIP(struct job * job, struct slot * slot) {
+    if (job->cancelled || job->paused || job->portsLen == 0) {
+        return false;
+    }
+
+    if (job->next6 != NULL) {
+        return jobNextIP6(job, slot);
+    }
+
+    if (!prefixNext(& job->prefixes, & job->targets, & slot->ip)) {
+        return false;
+    }
+
+    slot->block = blockOf(slot->ip);
+    return true;
+}
+
+static bool jobFinished(struct job * job) {
+    return job->inFlight == 0 && (
+        job->cancelled || job->portsLen == 0 ||
+        (job->next6 != NULL ? !job->hasLookahead6 && !job->more6 : prefixDone(& job->prefixes))
+    );
+}
+
+static struct job * pickJob(struct slot * slot) {
+    for (unsigned int i = 0; i <= jobsLen; ++i) {
+        if (current == NULL) {
+            current = jobs;
+
+            if (current == NULL) {
+                return NULL;
+            }
+
+            current->credits = current->priority;
+        }
+
+        if (current->credits > 0 && jobNextIP(current, slot)) {
+            --current->credits;
+            return current;
+        }
+
+        current = current->next;
+        if (current != NULL) {
+            current->credits = current->priority;
+        }
+    }
+
+    return NULL;
+}
+
+/* Returns true if some job was finished */
+static bool reapJobs(void) {
+    struct job ** link = & jobs;
+    bool reaped = false;
+
+    while (* link != NULL) {
+        struct job * job = * link;
+
+        if (!jobFinished(job)) {
+            link = & job->next;
+            continue;
+        }
+
+        * link = job->next;
+        --jobsLen;
+
+        if (current == job) {
+            current = job->next;
+
+            if (current != NULL) {
+                current->credits = current->priority;
+            }
+        }
+
+        prefixFree(& job->prefixes);
+
+        releaseOrder(job->order);
+        free(job->portHits);
+        free(job->portPos);
+
+        if (job->onDone != NULL) {
+            job->onDone(job);
+        }
+
+        reaped = true;
+    }
+
+    return reaped;
+}
+
+static void releaseSlot(struct slot * slot) {
+    capRelease(& hostCaps, slot->ip);
+    capRelease(& blockCaps, slot->block);
+    releaseOrder(slot->order);
+
+    if (!slot->job->cancelled) {
+        prefixHost(& slot->job->prefixes, slot->ip, slot->answered);
+    }
+
+    --slot->job->inFlight;
+    slot->job = NULL;
+
+    freeSlots[freeLen++] = slot - slots;
+}
+
+static void submitProbe(unsigned int tag) {
+    struct slot * slot = & slots[tag];
+    unsigned short port = slotPort(slot);
+
+    if (options.debug) {
+        static char strIP[40];
+
+        if (slot->job->next6 != NULL) {
+            ip6ToStr(& slot->ip6, strIP);
+            printf("Check connection to [%s]:%hu\n", strIP, port);
+        } else {
+            ipNumToStr(slot->ip, strIP);
+            printf("Check connection to %s:%hu\n", strIP, port);
+        }
+    }
+
+    slot->start = backend->now();
+
+    if (slot->job->next6 != NULL) {
+        backend->submit6(tag, & slot->ip6, port, slot->job->delay * 1000);
+    } else {
+        backend->submit(tag, slot->ip, port, slot->job->delay * 1000);
+    }
+}
+
+static void completeProbe(struct slot * slot, enum probeStatus status) {
+    struct job * job = slot->job;
+
+    if (job->cancelled) {
+        releaseSlot(slot);
+        return;
+    }
+
+    if (status == PROBE_RETRY) {
+        unsigned int inFlight = slotsLen - freeLen - pendingLen;
+
+        slotsLimit = inFlight > 1 ? inFlight - 1 : 1;
+        slotsGrowth = 0;
+        retryAt = backend->now() + ENGINE_RETRY_DELAY;
+
+        pendingSlots[pendingLen++] = slot - slots;
+        return;
+    }
+
+    if (slotsLimit < slotsLen && ++slotsGrowth >= slotsLimit) {
+        ++slotsLimit;
+        slotsGrowth = 0;
+    }
+
+    prefixProbe(& job->prefixes, slot->ip, backend->now() - slot->start);
+
+    if (status == PROBE_OPEN || status == PROBE_CLOSED) {
+        slot->answered = true;
+    }
+
+    if (status == PROBE_TIMEOUT && slot->attempt < job->retries) {
+        ++slot->attempt;
+
+        pendingSlots[pendingLen++] = slot - slots;
+        return;
+    }
+
+    if (job->onProbe != NULL) {
+        job->onProbe(job, slot->ip, slotPort(slot), status);
+    }
+
+    if (status == PROBE_OPEN) {
+        if (job->next6 != NULL) {
+            job->onHit6(job, & slot->ip6, slotPort(slot));
+        } else {
+            job->onHit(job, slot->ip, slotPort(slot));
+        }
+
+        slot->hit = true;
+
+        if (job->learnPorts) {
+            learnPort(job, slot->order->idx[slot->portIdx]);
+        }
+
+        if (!job->allPorts) {
+            releaseSlot(slot);
+            return;
+        }
+    }
+
+    slot->attempt = 0;
+    if (++slot->portIdx < job->portsLen) {
+        pendingSlots[pendingLen++] = slot - slots;
+        return;
+    }
+
+    if (!slot->hit) {
+        if (job->next6 != NULL && job->onBoo6 != NULL) {
+            job->onBoo6(job, & slot->ip6);
+        } else if (job->next6 == NULL && job->onBoo != NULL) {
+            job->onBoo(job, slot->ip);
+        }
+    }
+
+    releaseSlot(slot);
+}
+
+void engineInit(unsigned int maxInFlight, unsigned int rate, const struct backend * b) {
+    backend = b;
+    slotsLen = backend->init(maxInFlight);
+
+    slots = calloc(slotsLen, sizeof(struct slot));
+    done = calloc(slotsLen, sizeof(struct probe));
+    freeSlots = calloc(slotsLen, sizeof(unsigned int));
+    pendingSlots = calloc(slotsLen, sizeof(unsigned int));
+
+    if (slots == NULL || done == NULL || freeSlots == NULL || pendingSlots == NULL) {
+        __error("calloc");
+    }
+
+    for (unsigned int i = 0; i < slotsLen; ++i) {
+        freeSlots[i] = slotsLen - i - 1;
+    }
+
+    freeLen = slotsLen;
+    slotsLimit = slotsLen;
+
+    rateLimitInit(& limit, rate, backend->now);
+
+    blockShift = 32 - (options.blockPrefix > 32 ? 32 : options.blockPrefix);
+
+    capInit(& hostCaps, options.maxPerHost);
+    capInit(& blockCaps, options.maxPerBlock);
+}
+
+void engineAddJob(struct job * job) {
+    job->inFlight = 0;
+    job->credits = 0;
+    job->cancelled = false;
+    job->hasLookahead6 = false;
+    job->more6 = job->next6 != NULL;
+    job->next = NULL;
+
+    job->order = newOrder(job->portsLen);
+    job->portHits = NULL;
+    job->portPos = NULL;
+
+    for (unsigned short i = 0; i < job->portsLen; ++i) {
+        job->order->idx[i] = i;
+    }
+
+    if (job->learnPorts) {
+        job->portHits = calloc(job->portsLen + 1, sizeof(unsigned int));
+        job->portPos = calloc(job->portsLen + 1, sizeof(unsigned short));
+
+        if (job->portHits == NULL || job->portPos == NULL) {
+            __error("calloc");
+        }
+
+        for (unsigned short i = 0; i < job->portsLen; ++i) {
+            job->portPos[i] = i;
+        }
+    }
+
+    prefixInit(& job->prefixes, !job->targets.sample && job->next6 == NULL, options.blockPrefix, options.deadAfter, slotsLen, admitIP);
+
+    if (job->priority == 0) {
+        job->priority = 1;
+    }
+
+    struct job ** link = & jobs;
+    while (* link != NULL) {
+        link = & (* link)->next;
+    }
+
+    * link = job;
+    ++jobsLen;
+}
+
+void engineCancelJob(struct job * job) {
+    job->cancelled = true;
+}
+
+bool engineIdle(void) {
+    return jobs == NULL;
+}
+
+int engineRun(struct pollfd * extra, unsigned int extraLen, int timeout) {
+    bool retrying = backend->now() < retryAt, limited = false;
+
+    while (pendingLen > 0) {
+        unsigned int tag = pendingSlots[pendingLen - 1];
+
+        if (slots[tag].job->cancelled) {
+            --pendingLen;
+            releaseSlot(& slots[tag]);
+            continue;
+        }
+
+        if (retrying || slotsLen - freeLen - pendingLen >= slotsLimit) {
+            break;
+        }
+
+        if (rateLimitTake(& limit, 1) == 0) {
+            limited = true;
+            break;
+        }
+
+        --pendingLen;
+        submitProbe(tag);
+    }
+
+    while (freeLen > 0 && slotsLen - freeLen < slotsLimit) {
+        if (rateLimitWait(& limit) > 0) {
+            limited = true;
+            break;
+        }
+
+        unsigned int tag = freeSlots[freeLen - 1];
+        struct slot * slot = & slots[tag];
+
+        struct job * job = pickJob(slot);
+        if (job == NULL) {
+            break;
+        }
+
+        rateLimitTake(& limit, 1);
+        --freeLen;
+
+        slot->job = job;
+        slot->order = job->order;
+        slot->portIdx = 0;
+        slot->attempt = 0;
+        slot->hit = false;
+        slot->answered = false;
+        ++job->inFlight;
+        ++job->order->refs;
+
+        capAcquire(& hostCaps, slot->ip);
+        capAcquire(& blockCaps, slot->block);
+
+        submitProbe(tag);
+    }
+
+    /* The caller gets back to a finished job before waiting for anything */
+    if (reapJobs()) {
+        timeout = 0;
+    }
+
+    if (limited) {
+        int remaining = rateLimitWait(& limit);
+
+        if (timeout < 0 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+
+    if (retrying && pendingLen > 0) {
+        int remaining = retryAt > backend->now() ? (int) (retryAt - backend->now()) : 0;
+
+        if (timeout < 0 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+
+    unsigned int doneLen = 0;
+
+    int ret = backend->poll(extra, extraLen, timeout, done, & doneLen);
+    if (ret == -1) {
+        return -1;
+    }
+
+    for (unsigned int i = 0; i < doneLen; ++i) {
+        completeProbe(& slots[done[i].tag], done[i].status);
+    }
+
+    reapJobs();
+    return ret;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#pragma once
+
+#include "backend.h"
+#include "targets.h"
+#include "prefix.h"
+#include "util.h"
+#include "bool.h"
+
+struct pollfd;
+struct portSequence;
+
+struct job {
+    struct targets targets;
+
+    unsigned short * ports;
+    unsigned short portsLen;
+
+    unsigned int delay;
+    unsigned int priority;
+    unsigned int retries;
+
+    /* Probe every port of a host instead of stopping at the first open one */
+    bool allPorts;
+
+    /* Probe the ports which were open on more hosts so far first */
+    bool learnPorts;
+
+    /* Set by the owner to hold new probes back, e.g. while its results wait to be sent */
+    bool paused;
+
+    void (* onHit)(struct job * job, unsigned int ip, unsigned short port);
+
+    /* Called with the final status of every probed port, may be NULL */
+    void (* onProbe)(struct job * job, unsigned int ip, unsigned short port, enum probeStatus status);
+    void (* onBoo)(struct job * job, unsigned int ip);
+
+    /* Called once the job is finished or, after engineCancelJob(), drained */
+    void (* onDone)(struct job * job);
+
+    /* Set for IPv6 jobs: addresses are taken from next6 instead of the targets and results
+       go to onHit6 and onBoo6, caps count the /64 networks as blocks */
+    bool (* next6)(struct job * job, struct ip6 * ip);
+    void (* onHit6)(struct job * job, const struct ip6 * ip, unsigned short port);
+    void (* onBoo6)(struct job * job, const struct ip6 * ip);
+
+    void * data;
+
+    /* Engine state */
+    struct prefixQueue prefixes;
+    struct portSequence * order;
+    unsigned int * portHits;
+    unsigned short * portPos;
+    unsigned int inFlight;
+    unsigned int credits;
+    bool cancelled;
+    struct ip6 lookahead6;
+    bool hasLookahead6, more6;
+    struct job * next;
+};
+
+extern const struct backend * findBackend(const char * name);
+
+extern void engineInit(unsigned int maxInFlight, unsigned int rate, const struct backend * backend);
+extern void engineAddJob(struct job * job);
+extern void engineCancelJob(struct job * job);
+extern bool engineIdle(void);
+
+/* Starts, polls and completes probes; revents of extra descriptors are filled as by poll() */
+extern int engineRun(struct pollfd * extra, unsigned int extraLen, int timeout);
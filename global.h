@@ -28,3 +28,6 @@ SOFTWARE. */
 #include <errno.h>
 
 #include "bool.h"
+
+/* Reports a failed system call and exits with its errno */
+#define __error(_desc) { perror("ERROR (" _desc ")"); exit(errno); }
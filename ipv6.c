@@ -0,0 +1,122 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ipv6.h"
+
+#include "platform.h"
+
+#include "backend.h"
+#include "options.h"
+#include "engine.h"
+#include "global.h"
+#include "bloom.h"
+#include "main.h"
+#include "util.h"
+
+/* About 0.05% of new addresses are taken for repeated ones */
+#define IPV6_BLOOM_BITS 16
+
+/* Shortest usual hitlist line, e.g. "2001:db8::1\n", to size the filter by the file */
+#define IPV6_MIN_LINE 12
+
+static struct bloom bloom;
+
+static unsigned long long addresses = 0, duplicates = 0;
+
+static bool nextAddress(struct job * job, struct ip6 * ip) {
+    while (targetsNext6(& job->targets, ip)) {
+        if (bloomAdd(& bloom, mix64(ip->hi ^ mix64(ip->lo)), mix64(ip->lo ^ mix64(ip->hi + 1)))) {
+            ++duplicates;
+            continue;
+        }
+
+        ++addresses;
+        return true;
+    }
+
+    return false;
+}
+
+static void jobHit(struct job * job, const struct ip6 * ip, unsigned short port) {
+    printHit6(ip, port);
+}
+
+static void jobBoo(struct job * job, const struct ip6 * ip) {
+    printBoo6(ip);
+}
+
+int ipv6Scan(void) {
+    static struct job job;
+
+    if (options.targets == NULL) {
+        fprintf(stderr, "ERROR: IPv6 scan needs a hitlist, set --targets\n");
+        return 1;
+    }
+
+    const struct backend * backend = findBackend(options.backend);
+    if (backend->submit6 == NULL) {
+        fprintf(stderr, "ERROR: Backend \"%s\" doesn't support IPv6\n", backend->name);
+        return 1;
+    }
+
+    if (!targetsOpen(& job.targets, options.targets)) {
+        perror("ERROR (targets)");
+        return 1;
+    }
+
+    bloomInit(& bloom, job.targets.len / IPV6_MIN_LINE + 1, IPV6_BLOOM_BITS);
+
+    job.ports = options.ports;
+    job.portsLen = options.portsLen;
+    job.delay = options.delay;
+    job.priority = 1;
+    job.retries = options.retries;
+    job.learnPorts = options.portOrder == PORT_ORDER_LEARNED;
+    job.next6 = nextAddress;
+    job.onHit6 = jobHit;
+    job.onBoo6 = options.printBoo ? jobBoo : NULL;
+
+    engineInit(options.concurrency, options.rate, backend);
+    engineAddJob(& job);
+
+    while (!engineIdle()) {
+        engineRun(NULL, 0, -1);
+    }
+
+    fprintf(stderr, "Hitlist: %llu addresses, %llu repeated skipped\n", addresses, duplicates);
+
+    if (backend->report != NULL) {
+        backend->report();
+    }
+
+    bloomFree(& bloom);
+    targetsClose(& job.targets);
+
+    return 0;
+}
+
+#endif
@@ -22,13 +22,22 @@ SOFTWARE. */
 
 #ifdef __linux__
 
+#define _POSIX_C_SOURCE 200809L
+
 #include "platform.h"
 
+#include <sys/resource.h>
+#include <poll.h>
+
+#include "ratelimit.h"
+#include "backend.h"
 #include "options.h"
 #include "global.h"
+#include "trace.h"
 #include "util.h"
 
-#define __error(_desc) { perror("ERROR (" _desc ")"); exit(errno); }
+/* Descriptors left to the output, the daemon clients and the resolver */
+#define SOCKET_FD_HEADROOM 64
 
 int setSocketNonBlock(int sock) {
     static int flags;
@@ -37,19 +46,157 @@ int setSocketNonBlock(int sock) {
     return fcntl(sock, F_SETFL, flags | O_NONBLOCK);
 }
 
-bool checkConnection(unsigned int ip, unsigned int port) {
-    static bool sockOk;
+struct socketProbe {
+    long long deadline;
+    unsigned int ip;
+    unsigned short port;
+    int fd;
+};
+
+static struct socketProbe * socketProbes = NULL;
+static unsigned int socketProbesLen = 0;
+
+static struct probe * socketReady = NULL;
+static unsigned int socketReadyLen = 0;
+
+static struct pollfd * socketFds = NULL;
+static unsigned int * socketFdTags = NULL;
+static unsigned int socketFdsCap = 0;
+
+static void socketComplete(unsigned int tag, enum probeStatus status) {
+    struct socketProbe * probe = & socketProbes[tag];
+
+    TRACE_DONE(probe->ip, probe->port, status);
+
+    if (probe->fd != -1) {
+        TRACE_BEGIN(TRACE_CLOSE, probe->ip, probe->port);
+
+        if (status == PROBE_OPEN) {
+            shutdown(probe->fd, SHUT_RDWR);
+        }
+
+        if (close(probe->fd) == -1) {
+            __error("close");
+        }
+
+        TRACE_END(TRACE_CLOSE, probe->ip, probe->port);
+
+        probe->fd = -1;
+    }
+
+    struct probe * ready = & socketReady[socketReadyLen++];
+    ready->tag = tag;
+    ready->ip = probe->ip;
+    ready->port = probe->port;
+    ready->status = status;
+}
+
+static enum probeStatus socketStatus(int error) {
+    switch (error) {
+    case 0:
+        return PROBE_OPEN;
+    case ECONNREFUSED:
+        return PROBE_CLOSED;
+    case ETIMEDOUT:
+        return PROBE_TIMEOUT;
+    default:
+        return PROBE_ERROR;
+    }
+}
+
+/* Every probe holds a descriptor, the soft limit is raised up to the hard one if needed */
+static unsigned int socketFdLimit(unsigned int maxInFlight) {
+    struct rlimit limit;
+    rlim_t needed = (rlim_t) maxInFlight + SOCKET_FD_HEADROOM;
+
+    if (getrlimit(RLIMIT_NOFILE, & limit) == -1 || limit.rlim_cur == RLIM_INFINITY || limit.rlim_cur >= needed) {
+        return maxInFlight;
+    }
+
+    limit.rlim_cur = limit.rlim_max != RLIM_INFINITY && limit.rlim_max < needed ? limit.rlim_max : needed;
+
+    if (setrlimit(RLIMIT_NOFILE, & limit) == -1 && getrlimit(RLIMIT_NOFILE, & limit) == -1) {
+        return maxInFlight;
+    }
 
-    static int sock;
-    sock = socket(AF_INET, SOCK_STREAM, 0);
-    if (sock == -1) {
-        __error("socket");
+    if (limit.rlim_cur >= needed) {
+        return maxInFlight;
     }
 
-    if (setSocketNonBlock(sock) == -1) {
+    unsigned int max = limit.rlim_cur > SOCKET_FD_HEADROOM * 2 ? limit.rlim_cur - SOCKET_FD_HEADROOM : limit.rlim_cur / 2;
+    if (max == 0) {
+        max = 1;
+    }
+
+    fprintf(stderr, "WARNING: Concurrency is limited to %u by the open files limit\n", max);
+    return max;
+}
+
+static unsigned int socketInit(unsigned int maxInFlight) {
+    maxInFlight = socketFdLimit(maxInFlight);
+
+    socketProbes = calloc(maxInFlight, sizeof(struct socketProbe));
+    socketReady = calloc(maxInFlight, sizeof(struct probe));
+
+    if (socketProbes == NULL || socketReady == NULL) {
+        __error("calloc");
+    }
+
+    socketProbesLen = maxInFlight;
+    for (unsigned int i = 0; i < socketProbesLen; ++i) {
+        socketProbes[i].fd = -1;
+    }
+
+    return maxInFlight;
+}
+
+static void socketConnect(
+    unsigned int tag, const struct sockaddr * sockAddr, socklen_t sockAddrLen,
+    unsigned int ip, unsigned short port, unsigned int timeout
+) {
+    struct socketProbe * probe = & socketProbes[tag];
+
+    probe->ip = ip;
+    probe->port = port;
+    probe->deadline = nowMs() + timeout;
+
+    TRACE_BEGIN(TRACE_SOCKET, ip, port);
+
+    probe->fd = socket(sockAddr->sa_family, SOCK_STREAM, 0);
+    if (probe->fd == -1) {
+        if (errno != EMFILE && errno != ENFILE) {
+            __error("socket");
+        }
+
+        TRACE_END(TRACE_SOCKET, ip, port);
+
+        socketComplete(tag, PROBE_RETRY);
+        return;
+    }
+
+    if (setSocketNonBlock(probe->fd) == -1) {
         __error("setSocketNonBlock");
     }
 
+    TRACE_END(TRACE_SOCKET, ip, port);
+    TRACE_BEGIN(TRACE_CONNECT, ip, port);
+
+    int ret = connect(probe->fd, sockAddr, sockAddrLen);
+
+    TRACE_END(TRACE_CONNECT, ip, port);
+
+    if (ret == 0) {
+        socketComplete(tag, PROBE_OPEN);
+    } else if (errno != EINPROGRESS) {
+        if (options.debug) {
+            perror("ERROR (connect)");
+        }
+
+        socketComplete(tag, socketStatus(errno));
+    }
+}
+
+static void socketSubmit(unsigned int tag, unsigned int ip, unsigned short port, unsigned int timeout) {
     static struct sockaddr_in sockAddr;
     memset(& sockAddr, 0, sizeof(sockAddr));
 
@@ -57,70 +204,130 @@ bool checkConnection(unsigned int ip, unsigned int port) {
     sockAddr.sin_port = htons(port);
     ipNumToAddr(ip, & sockAddr.sin_addr);
 
-    if (
-        connect(sock, (struct sockaddr *) & sockAddr, sizeof(sockAddr)) == -1 &&
-        errno == EINPROGRESS
-    ) {
-        static int maxFd = 0;
-        static fd_set rfds, wfds;
-        static struct timeval tv;
-
-        tv.tv_sec = 0;
-        tv.tv_usec = 500;
-        FD_ZERO(& rfds);
-        FD_ZERO(& wfds);
-
-        for (register unsigned int i = 0; i < options.delay; ++i) {
-            sleep(1);
-
-            FD_SET(sock, & wfds);
-            FD_SET(sock, & rfds);
-            if(sock > maxFd) {
-                maxFd = sock;
-            }
+    socketConnect(tag, (struct sockaddr *) & sockAddr, sizeof(sockAddr), ip, port, timeout);
+}
 
-            select(maxFd + 1, & rfds, & wfds, NULL, & tv);
+static void socketSubmit6(unsigned int tag, const struct ip6 * ip, unsigned short port, unsigned int timeout) {
+    static struct sockaddr_in6 sockAddr;
+    memset(& sockAddr, 0, sizeof(sockAddr));
 
-            if (FD_ISSET(sock, & wfds) || FD_ISSET(sock, & rfds)) {
-                break;
-            }
+    sockAddr.sin6_family = PF_INET6;
+    sockAddr.sin6_port = htons(port);
+    ip6ToAddr(ip, & sockAddr.sin6_addr);
+
+    socketConnect(tag, (struct sockaddr *) & sockAddr, sizeof(sockAddr), 0, port, timeout);
+}
+
+static int socketPoll(
+    struct pollfd * extra, unsigned int extraLen, int timeout,
+    struct probe * done, unsigned int * doneLen
+) {
+    if (socketFdsCap < extraLen + socketProbesLen) {
+        socketFdsCap = extraLen + socketProbesLen;
+
+        socketFds = realloc(socketFds, socketFdsCap * sizeof(struct pollfd));
+        socketFdTags = realloc(socketFdTags, socketFdsCap * sizeof(unsigned int));
+
+        if (socketFds == NULL || socketFdTags == NULL) {
+            __error("realloc");
+        }
+    }
+
+    if (extraLen > 0) {
+        memcpy(socketFds, extra, extraLen * sizeof(struct pollfd));
+    }
+
+    long long now = nowMs();
+    unsigned int fdsLen = extraLen;
+
+    if (socketReadyLen > 0) {
+        timeout = 0;
+    }
+
+    for (unsigned int i = 0; i < socketProbesLen; ++i) {
+        struct socketProbe * probe = & socketProbes[i];
+
+        if (probe->fd == -1) {
+            continue;
         }
 
-        if (!FD_ISSET(sock, & wfds) && !FD_ISSET(sock, & rfds)) {
-            sockOk = false;
+        socketFds[fdsLen].fd = probe->fd;
+        socketFds[fdsLen].events = POLLOUT;
+        socketFds[fdsLen].revents = 0;
+        socketFdTags[fdsLen] = i;
+        ++fdsLen;
 
-            if (options.debug) {
-                fprintf(stderr, "ERROR (connect): Timed out\n");
-            }
-        } else {
+        int remaining = probe->deadline > now ? (int) (probe->deadline - now) : 0;
+        if (timeout < 0 || remaining < timeout) {
+            timeout = remaining;
+        }
+    }
+
+    TRACE_BEGIN(TRACE_POLL, 0, 0);
+
+    int ret = poll(socketFds, fdsLen, timeout);
+
+    TRACE_END(TRACE_POLL, 0, 0);
+
+    if (ret == -1) {
+        if (errno == EINTR) {
+            return -1;
+        }
+
+        __error("poll");
+    }
+
+    for (unsigned int i = 0; i < extraLen; ++i) {
+        extra[i].revents = socketFds[i].revents;
+    }
+
+    now = nowMs();
+
+    for (unsigned int i = extraLen; i < fdsLen; ++i) {
+        unsigned int tag = socketFdTags[i];
+
+        if (socketFds[i].revents != 0) {
             static socklen_t errLen;
             static int error;
 
+            TRACE_BEGIN(TRACE_GETSOCKOPT, socketProbes[tag].ip, socketProbes[tag].port);
+
             errLen = sizeof(error);
-            if (
-                getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *) & error, & errLen) == -1 ||
-                error != 0
-            ) {
-                sockOk = false;
-
-                if (options.debug) {
-                    fprintf(stderr, "ERROR (connect): Socket error\n");
-                }
-            } else {
-                sockOk = true;
+            if (getsockopt(socketProbes[tag].fd, SOL_SOCKET, SO_ERROR, (char *) & error, & errLen) == -1) {
+                error = errno;
             }
-        }
-    }
 
-    if (sockOk && shutdown(sock, SHUT_RDWR) == -1) {
-        __error("shutdown");
-    }
+            TRACE_END(TRACE_GETSOCKOPT, socketProbes[tag].ip, socketProbes[tag].port);
+
+            if (error != 0 && options.debug) {
+                fprintf(stderr, "ERROR (connect): Socket error\n");
+            }
+
+            socketComplete(tag, socketStatus(error));
+        } else if (now >= socketProbes[tag].deadline) {
+            if (options.debug) {
+                fprintf(stderr, "ERROR (connect): Timed out\n");
+            }
 
-    if (close(sock) == -1) {
-        __error("close");
+            socketComplete(tag, PROBE_TIMEOUT);
+        }
     }
 
-    return sockOk;
+    memcpy(done, socketReady, socketReadyLen * sizeof(struct probe));
+    * doneLen = socketReadyLen;
+    socketReadyLen = 0;
+
+    return ret;
 }
 
+const struct backend socketBackend = {
+    "socket",
+    socketInit,
+    socketSubmit,
+    socketPoll,
+    nowMs,
+    NULL,
+    socketSubmit6
+};
+
 #endif
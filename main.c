@@ -24,9 +24,264 @@ SOFTWARE. */
 
 #include "platform.h"
 #include "options.h"
+#include "targets.h"
+#include "ports.h"
 #include "global.h"
+#include "trace.h"
 #include "util.h"
 
+#ifdef __linux__
+#include <math.h>
+#include <poll.h>
+
+#include "daemon.h"
+#include "engine.h"
+#include "ipv6.h"
+#include "resolve.h"
+#include "sample.h"
+#include "udp.h"
+#endif
+
+FILE * output = NULL;
+
+void printHit(unsigned int ip, unsigned short port) {
+#ifdef __linux__
+
+    if (options.resolve != NULL) {
+        resolveHit(ip, port);
+        return;
+    }
+
+#endif
+
+    printHitName(ip, port, NULL);
+}
+
+void printHitName(unsigned int ip, unsigned short port, const char * name) {
+    TRACE_BEGIN(TRACE_OUTPUT, ip, port);
+
+    static char strIP[16];
+    ipNumToStr(ip, strIP);
+
+    if (output != NULL) {
+        if (
+            (name != NULL ? fprintf(output, "%s:%u %s\n", strIP, port, name) :
+            fprintf(output, "%s:%u\n", strIP, port)) < 0 && options.debug
+        ) {
+            perror("ERROR (fprintf)");
+        }
+
+        if (fflush(output) == EOF && options.debug) {
+            perror("ERROR (fflush)");
+        }
+    }
+
+    if (name != NULL) {
+        printf("IP %s (%s) has been responsed on port %hu. (yay!!!)\n", strIP, name, port);
+    } else {
+        printf("IP %s has been responsed on port %hu. (yay!!!)\n", strIP, port);
+    }
+
+    TRACE_END(TRACE_OUTPUT, ip, port);
+}
+
+void printBoo(unsigned int ip) {
+    TRACE_BEGIN(TRACE_OUTPUT, ip, 0);
+
+    static char strIP[16];
+    ipNumToStr(ip, strIP);
+
+    printf("IP %s hasn't been responsed. (booooo)\n", strIP);
+
+    TRACE_END(TRACE_OUTPUT, ip, 0);
+}
+
+void printHit6(const struct ip6 * ip, unsigned short port) {
+    TRACE_BEGIN(TRACE_OUTPUT, 0, port);
+
+    static char strIP[40];
+    ip6ToStr(ip, strIP);
+
+    if (output != NULL) {
+        if (fprintf(output, "[%s]:%u\n", strIP, port) < 0 && options.debug) {
+            perror("ERROR (fprintf)");
+        }
+
+        if (fflush(output) == EOF && options.debug) {
+            perror("ERROR (fflush)");
+        }
+    }
+
+    printf("IP %s has been responsed on port %hu. (yay!!!)\n", strIP, port);
+
+    TRACE_END(TRACE_OUTPUT, 0, port);
+}
+
+void printBoo6(const struct ip6 * ip) {
+    TRACE_BEGIN(TRACE_OUTPUT, 0, 0);
+
+    static char strIP[40];
+    ip6ToStr(ip, strIP);
+
+    printf("IP %s hasn't been responsed. (booooo)\n", strIP);
+
+    TRACE_END(TRACE_OUTPUT, 0, 0);
+}
+
+#ifdef __linux__
+
+static void jobHit(struct job * job, unsigned int ip, unsigned short port) {
+    printHit(ip, port);
+}
+
+static void jobBoo(struct job * job, unsigned int ip) {
+    printBoo(ip);
+}
+
+static void jobProbe(struct job * job, unsigned int ip, unsigned short port, enum probeStatus status) {
+    sampleProbe(ip, port, status);
+}
+
+int scan(void) {
+    static struct job job;
+    bool sampling = options.sample > 0 || options.sampleCi > 0;
+
+    if (sampling) {
+        if (options.targets != NULL) {
+            fprintf(stderr, "ERROR: Targets file can't be sampled\n");
+            return 1;
+        }
+
+        unsigned long long size = options.ipRange[1] - options.ipRange[0];
+
+        targetsSample(& job.targets, options.ipRange[0], options.ipRange[1],
+            options.sample > 0 ? (unsigned long long) ceil(options.sample * size) : size, options.seed);
+
+        if (!sampleInit(& job.targets)) {
+            return 1;
+        }
+    } else if (!targetsOpenOptions(& job.targets)) {
+        perror("ERROR (targets)");
+        return 1;
+    }
+
+    job.ports = options.ports;
+    job.portsLen = options.portsLen;
+    job.delay = options.delay;
+    job.priority = 1;
+    job.retries = options.retries;
+    job.allPorts = sampling;
+    job.learnPorts = options.portOrder == PORT_ORDER_LEARNED;
+    job.onHit = jobHit;
+    job.onBoo = options.printBoo ? jobBoo : NULL;
+    job.onProbe = sampling ? jobProbe : NULL;
+    job.onDone = NULL;
+
+    const struct backend * backend = findBackend(options.backend);
+
+    engineInit(options.concurrency, options.rate, backend);
+    engineAddJob(& job);
+
+    long long lastReport = backend->now();
+    unsigned long long lastHosts = 0;
+
+    while (!engineIdle()) {
+        struct pollfd extra = { -1, POLLIN, 0 };
+        int timeout = sampling ? 1000 : -1;
+
+        if (options.resolve != NULL) {
+            extra.fd = resolveFd(& timeout);
+        }
+
+        engineRun(& extra, extra.fd != -1 ? 1 : 0, timeout);
+
+        if (options.resolve != NULL) {
+            resolvePoll();
+        }
+
+        if (!sampling) {
+            continue;
+        }
+
+        if (options.sampleCi > 0 && sampleEnough()) {
+            job.targets.sampleLen = job.targets.sampleIdx;
+        }
+
+        if (backend->now() - lastReport >= 1000 && sampleHosts() != lastHosts) {
+            lastReport = backend->now();
+            lastHosts = sampleHosts();
+
+            sampleReport(false);
+        }
+    }
+
+    if (sampling) {
+        sampleReport(true);
+    } else {
+        prefixReport(& job.prefixes);
+    }
+
+    if (backend->report != NULL) {
+        backend->report();
+    }
+
+    targetsClose(& job.targets);
+    return 0;
+}
+
+#else
+
+void scanRange(unsigned int begin, unsigned int end) {
+    char strIP[16];
+    bool sockOk = false;
+
+    for (unsigned int ip = begin; ip < end; ++ip) {
+        for (unsigned int port = 0; port < options.portsLen; ++port) {
+            if (options.debug) {
+                ipNumToStr(ip, strIP);
+                printf("Check connection to %s:%hu\n", strIP, options.ports[port]);
+            }
+
+            sockOk = checkConnection(ip, options.ports[port]);
+
+            if (sockOk) {
+                printHit(ip, options.ports[port]);
+
+                break;
+            }
+
+            continue;
+        }
+
+        if (options.printBoo && !sockOk) {
+            printBoo(ip);
+        }
+    }
+}
+
+int scan(void) {
+    if (options.targets == NULL) {
+        scanRange(options.ipRange[0], options.ipRange[1]);
+        return 0;
+    }
+
+    static struct targets targets;
+    if (!targetsOpen(& targets, options.targets)) {
+        perror("ERROR (targets)");
+        return 1;
+    }
+
+    static unsigned int range[2];
+    while (targetsNext(& targets, range)) {
+        scanRange(range[0], range[1]);
+    }
+
+    targetsClose(& targets);
+    return 0;
+}
+
+#endif
+
 int main(int argc, char ** argv) {
     initOptions(argv[0]);
 
@@ -34,8 +289,22 @@ int main(int argc, char ** argv) {
         parseArgument(argv[i]);
     }
 
-    char strIP[16];
-    bool sockOk = false;
+    if (options.portOrder != PORT_ORDER_GIVEN) {
+        options.portsLen = sortPortsByFrequency(options.ports, options.portsLen);
+    }
+
+#ifdef TRACE
+
+    traceInit();
+
+#else
+
+    if (options.profileReport) {
+        fprintf(stderr, "ERROR: Profile report isn't compiled in, build with \"make TRACE=1\"\n");
+        exit(1);
+    }
+
+#endif
 
 #ifdef _WIN32
 
@@ -50,7 +319,6 @@ int main(int argc, char ** argv) {
 
 #endif
 
-    FILE * output = NULL;
     if (options.output != NULL) {
         output = fopen(options.output, "w");
 
@@ -59,46 +327,145 @@ int main(int argc, char ** argv) {
         }
     }
 
-    for (unsigned int ip = options.ipRange[0]; ip < options.ipRange[1]; ++ip) {
-        ipNumToStr(ip, strIP);
+    int ret;
 
-        for (unsigned int port = 0; port < options.portsLen; ++port) {
-            if (options.debug) {
-                printf("Check connection to %s:%hu\n", strIP, options.ports[port]);
-            }
+#ifdef __linux__
 
-            sockOk = checkConnection(ip, options.ports[port]);
+    if (findBackend(options.backend) == NULL) {
+        fprintf(stderr, "ERROR: Unknown backend \"%s\"\n", options.backend);
+        exit(1);
+    }
 
-            if (sockOk) {
-                if (output != NULL) {
-                    if (fprintf(output, "%s:%u\n", strIP, options.ports[port]) < 0 && options.debug) {
-                        perror("ERROR (fprintf)");
-                    }
+    if (options.ipv6) {
+        if (options.udp) {
+            fprintf(stderr, "ERROR: UDP mode doesn't probe IPv6 addresses\n");
+            exit(1);
+        }
 
-                    if (fflush(output) == EOF && options.debug) {
-                        perror("ERROR (fflush)");
-                    }
-                }
+        if (options.daemon != NULL || options.submit != NULL) {
+            fprintf(stderr, "ERROR: Daemon doesn't probe IPv6 addresses\n");
+            exit(1);
+        }
 
-                printf("IP %s has been responsed on port %hu. (yay!!!)\n", strIP, options.ports[port]);
+        if (options.sample > 0 || options.sampleCi > 0) {
+            fprintf(stderr, "ERROR: IPv6 hitlist can't be sampled\n");
+            exit(1);
+        }
 
-                break;
-            }
+        if (options.resolve != NULL) {
+            fprintf(stderr, "ERROR: IPv6 hits aren't resolved\n");
+            exit(1);
+        }
 
-            continue;
+        /* Hitlist addresses are taken in order, so one at its cap would hold back the whole scan */
+        if (options.maxPerHost > 0 || options.maxPerBlock > 0) {
+            fprintf(stderr, "ERROR: IPv6 scan doesn't cap probes in flight\n");
+            exit(1);
+        }
+    }
+
+    if ((options.daemon != NULL || options.submit != NULL) && (options.sample > 0 || options.sampleCi > 0)) {
+        fprintf(stderr, "ERROR: Daemon jobs aren't sampled\n");
+        exit(1);
+    }
+
+    if (options.udp) {
+        if (options.daemon != NULL || options.submit != NULL) {
+            fprintf(stderr, "ERROR: UDP mode doesn't run as daemon jobs\n");
+            exit(1);
         }
 
-        if (options.printBoo && !sockOk) {
-            printf("IP %s hasn't been responsed. (booooo)\n", strIP);
+        if (options.sample > 0 || options.sampleCi > 0) {
+            fprintf(stderr, "ERROR: UDP mode doesn't sample ranges\n");
+            exit(1);
+        }
+
+        if (options.maxPerHost > 0 || options.maxPerBlock > 0) {
+            fprintf(stderr, "ERROR: UDP mode doesn't cap probes in flight\n");
+            exit(1);
+        }
+
+        if (strcmp(options.backend, "socket") != 0) {
+            fprintf(stderr, "ERROR: UDP mode only probes with the socket backend\n");
+            exit(1);
+        }
+    }
+
+    if (options.resolve != NULL) {
+        if (options.daemon != NULL) {
+            fprintf(stderr, "ERROR: Daemon doesn't resolve names, pass --resolve to submitting clients\n");
+            exit(1);
+        }
+
+        if (!resolveInit(options.resolve)) {
+            exit(1);
+        }
+    }
+
+    if (options.udp) {
+        ret = udpScan();
+    } else if (options.ipv6) {
+        ret = ipv6Scan();
+    } else if (options.daemon != NULL) {
+        ret = runDaemon(options.daemon);
+    } else if (options.submit != NULL) {
+        if (options.targets != NULL) {
+            fprintf(stderr, "ERROR: Targets file can't be submitted to daemon\n");
+            exit(1);
         }
+
+        /* A job line carries only the range, ports, delay, priority and --print-boo */
+        if (
+            options.retries != 0 || options.portOrder == PORT_ORDER_LEARNED || options.rate != 0 ||
+            options.maxPerHost > 0 || options.maxPerBlock > 0 || strcmp(options.backend, "socket") != 0
+        ) {
+            fprintf(stderr, "ERROR: Retries, learned port order, rate, caps and backend of jobs are set by the daemon\n");
+            exit(1);
+        }
+
+        ret = runClient(options.submit);
+    } else {
+        ret = scan();
+    }
+
+    if (options.resolve != NULL) {
+        resolveFlush();
     }
 
+#else
+
+    if (options.daemon != NULL || options.submit != NULL) {
+        fprintf(stderr, "ERROR: Daemon mode isn't supported on this platform\n");
+        ret = 1;
+    } else if (options.udp) {
+        fprintf(stderr, "ERROR: UDP mode isn't supported on this platform\n");
+        ret = 1;
+    } else if (options.resolve != NULL) {
+        fprintf(stderr, "ERROR: Resolving names isn't supported on this platform\n");
+        ret = 1;
+    } else if (options.ipv6) {
+        fprintf(stderr, "ERROR: IPv6 mode isn't supported on this platform\n");
+        ret = 1;
+    } else {
+        ret = scan();
+    }
+
+#endif
+
     if (output != NULL) {
         if (fclose(output) == EOF && options.debug) {
             perror("ERROR (fclose)");
         }
     }
 
+#ifdef TRACE
+
+    if (options.profileReport) {
+        traceReport();
+    }
+
+#endif
+
 #ifdef _WIN32
 
     if (WSACleanup() == SOCKET_ERROR) {
@@ -108,5 +475,5 @@ int main(int argc, char ** argv) {
 
 #endif
 
-    return 0;
+    return ret;
 }
@@ -20,4 +20,22 @@ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
 OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE. */
 
+
 #pragma once
+
+#include <stdio.h>
+
+#include "bool.h"
+
+struct ip6;
+
+extern FILE * output;
+
+extern void printHit(unsigned int ip, unsigned short port);
+
+/* Prints a hit annotated with the host name, name may be NULL */
+extern void printHitName(unsigned int ip, unsigned short port, const char * name);
+extern void printBoo(unsigned int ip);
+
+extern void printHit6(const struct ip6 * ip, unsigned short port);
+extern void printBoo6(const struct ip6 * ip);
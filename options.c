@@ -22,7 +22,9 @@ SOFTWARE. */
 
 #include "options.h"
 
+#include "daemon.h"
 #include "global.h"
+#include "ports.h"
 #include "util.h"
 
 static const char * HELP =
@@ -31,7 +33,8 @@ static const char * HELP =
     "=====================================\n\n"
     "Desription: scans a range of IPv4 addresses by ports\n\n"
     "Usage: %s [<options>] [--] [<begin IP>] [<end IP>]\n\n"
-    "Begin IP: a first IP to scanning in 255.255.255.255 format\n\n"
+    "Begin IP: a first IP to scanning in 255.255.255.255 format\n"
+    "  or a block to scanning in 255.255.255.0/24 format without end IP\n\n"
     "End IP: a next IP after last to scanning in 255.255.255.255 format\n\n"
     "Options:\n"
     "  --help (-h)\n"
@@ -42,16 +45,82 @@ static const char * HELP =
     "    Print bad IP?\n\n"
     "  --debug (-D)\n"
     "    Print more info?\n\n"
+    "  --udp (-u)\n"
+    "    Probe UDP ports with protocol payloads (DNS, NTP, NetBIOS, SNMP, SSDP, memcached)\n"
+    "    instead of TCP connections, every responded port is printed.\n\n"
     "  --ports (-p)\n"
-    "    Ports for check, one or more numbers in from 0 to 65535. Default: 80 443.\n\n"
+    "    Ports for check, one or more numbers from 1 to 65535, ranges like 1-1024 (port 0\n"
+    "    of a range is skipped) or lists of the most often open ports top1 to top100, e.g. top20.\n"
+    "    Default: 80 443.\n\n"
+    "  --port-order (-O)\n"
+    "    Order of ports probed on every host: \"given\", \"probability\" to probe the most\n"
+    "    often open ports first or \"learned\" to reorder them by hits of the scan so far.\n"
+    "    Default: given.\n\n"
+    "  --resolve (-N)\n"
+    "    Annotate hits with PTR names looked up asynchronously from a DNS resolver,\n"
+    "    address of resolver in 255.255.255.255 or 255.255.255.255:53 format. Default: not setted.\n\n"
+    "  --profile-report (-T)\n"
+    "    Print wall and CPU time of the run by probe phase at exit,\n"
+    "    available in builds made with \"make TRACE=1\".\n\n"
     "  --delay (-d)\n"
-    "    Connection waiting time, seconds. Default: 5 sec.\n\n"
+    "    Connection waiting time, seconds, at most 3600. Default: 5 sec.\n\n"
     "  --output (-o)\n"
     "    File to save an \"ip:port\" pairs list, path to file. Default: not setted.\n"
-    "    !!! FILE WILL BE REWRITTEN ANYWAY !!!\n\n";
+    "    !!! FILE WILL BE REWRITTEN ANYWAY !!!\n\n"
+    "  --targets (-t)\n"
+    "    File with IPs or blocks in 255.255.255.0/24 format to scanning instead of the range,\n"
+    "    one per line, path to file. Default: not setted.\n\n"
+    "  --ipv6 (-6)\n"
+    "    Scan IPv6 addresses of the --targets hitlist, one per line, repeated ones are skipped.\n"
+    "    Hits are saved in \"[ip]:port\" format.\n\n"
+    "  --daemon (-S)\n"
+    "    Run as a scanning daemon listening for jobs on a Unix socket, path to socket.\n"
+    "    Default: not setted.\n\n"
+    "  --submit (-s)\n"
+    "    Submit the scan as a job to a running daemon, path to socket. Default: not setted.\n\n"
+    "  --priority (-P)\n"
+    "    Job share of the daemon probe slots, a number from 1 to 100. Default: 1.\n\n"
+    "  --rate (-r)\n"
+    "    Maximum number of probes per second, 0 for unlimited. Default: 0.\n\n"
+    "  --concurrency (-c)\n"
+    "    Maximum number of probes in flight, lowered to fit the open files limit. Default: 256.\n\n"
+    "  --retries (-R)\n"
+    "    Number of repeated probes of a timed out port. Default: 0.\n\n"
+    "  --backend (-B)\n"
+    "    Probe backend: \"socket\" or \"sim\" to probe a simulated network. Default: socket.\n\n"
+    "  --sim-config (-C)\n"
+    "    Simulated network model, path to file with lines of\n"
+    "    \"<block> <live hosts> <open ports> <RTT, ms> <RTT jitter, ms> <loss> [<probes per sec per /24>]\",\n"
+    "    shares are from 0 to 1, the longest matching block is used.\n"
+    "    Default: 0.0.0.0/0 0.1 0.2 100 50 0.01.\n\n"
+    "  --seed (-E)\n"
+    "    Seed of the simulated network and of the sample. Default: 0.\n\n"
+    "  --sample (-f)\n"
+    "    Probe a random share of the range, from 0 to 1, and print estimates of\n"
+    "    exposed hosts per port and per block with 95%% confidence intervals.\n"
+    "    Every port of sampled hosts is probed. Default: not setted.\n\n"
+    "  --sample-until-ci (-I)\n"
+    "    Sample until the confidence interval half-width of every port share is at most this,\n"
+    "    e.g. 0.001 for +- 0.1%%, the sampled share is limited by --sample. Default: not setted.\n\n"
+    "  --sample-prefix (-L)\n"
+    "    Prefix length of blocks to estimate in sampling mode. Default: 16.\n\n"
+    "  --block-prefix (-k)\n"
+    "    Prefix length of blocks whose liveness is learned during the scan, addresses\n"
+    "    of different blocks are probed interleaved. Default: 24.\n\n"
+    "  --dead-after (-A)\n"
+    "    Number of first hosts of a block which all timed out to defer the rest of\n"
+    "    the block to the end of the scan, 0 to never defer. Default: 16.\n\n"
+    "  --max-per-host (-H)\n"
+    "    Maximum number of probes in flight to one host over all jobs, 0 for unlimited.\n"
+    "    Default: 0.\n\n"
+    "  --max-per-block (-K)\n"
+    "    Maximum number of probes in flight to one block of --block-prefix length\n"
+    "    over all jobs, e.g. 32 for a /24, 0 for unlimited. Default: 0.\n\n";
 
 const char * path;
 
+struct options options;
+
 void initOptions(const char * p) {
     path = p;
 
@@ -63,17 +132,96 @@ void initOptions(const char * p) {
     options.portsLen = 2;
 
     options.delay = 5;
+    options.priority = 1;
+    options.rate = 0;
+    options.concurrency = 256;
+    options.retries = 0;
+    options.seed = 0;
+    options.samplePrefix = 16;
+    options.blockPrefix = 24;
+    options.deadAfter = 16;
+    options.maxPerHost = 0;
+    options.maxPerBlock = 0;
+    options.portOrder = PORT_ORDER_GIVEN;
+
+    options.sample = 0;
+    options.sampleCi = 0;
 
     options.printBoo = false;
     options.debug = false;
+    options.udp = false;
+    options.profileReport = false;
+    options.ipv6 = false;
 
     options.output = NULL;
+    options.targets = NULL;
+    options.daemon = NULL;
+    options.submit = NULL;
+    options.backend = "socket";
+    options.simConfig = NULL;
+    options.resolve = NULL;
 }
 
+static bool portAdded[65536];
+
 void resetPorts(void) {
     static unsigned short ports[65536] = {};
     options.ports = ports;
     options.portsLen = 0;
+
+    memset(portAdded, 0, sizeof(portAdded));
+}
+
+static void addPort(unsigned short port) {
+    if (portAdded[port]) {
+        return;
+    }
+
+    if (options.portsLen == 65535) {
+        fprintf(stderr, "ERROR: Too many ports\n");
+        exit(1);
+    }
+
+    portAdded[port] = true;
+    options.ports[options.portsLen++] = port;
+}
+
+static void parsePorts(const char * arg) {
+    static unsigned int count;
+    const unsigned short * list = findTopPorts(arg, & count);
+
+    if (list != NULL) {
+        for (unsigned int i = 0; i < count; ++i) {
+            addPort(list[i]);
+        }
+
+        return;
+    }
+
+    static char * end;
+    static unsigned long first, last;
+
+    first = strtoul(arg, & end, 10);
+    last = first;
+
+    if (end != arg && * end == '-') {
+        const char * lastStr = end + 1;
+        last = strtoul(lastStr, & end, 10);
+
+        if (end == lastStr) {
+            end = (char *) arg;
+        }
+    }
+
+    if (end == arg || * end != '\0' || first > last || last > 65535 || last == 0) {
+        fprintf(stderr, "ERROR: Invalid port \"%s\"\n", arg);
+        exit(1);
+    }
+
+    /* Port 0 can't be probed, so 0-65535 fits the port list */
+    for (unsigned long port = first > 0 ? first : 1; port <= last; ++port) {
+        addPort(port);
+    }
 }
 
 void printHelpAndExit(void) {
@@ -123,16 +271,64 @@ void unknownOption(const char * _option, bool shortOption) {
     exit(1);
 }
 
+char * copyString(const char * str) {
+    static size_t s;
+    s = strlen(str) + 1;
+
+    char * ret = malloc(s);
+    strncpy(ret, str, s);
+
+    return ret;
+}
+
 void parseArgument(const char * arg) {
-    static bool ports   = false,
-                delay   = false,
-                output  = false,
-                beginIP = false;
+    static bool ports        = false,
+                delay        = false,
+                output       = false,
+                targets      = false,
+                daemon       = false,
+                submit       = false,
+                priority     = false,
+                rate         = false,
+                concurrency  = false,
+                retries      = false,
+                backend      = false,
+                simConfig    = false,
+                seed         = false,
+                sample       = false,
+                sampleCi     = false,
+                samplePrefix = false,
+                blockPrefix  = false,
+                deadAfter    = false,
+                maxPerHost   = false,
+                maxPerBlock  = false,
+                portOrder    = false,
+                resolve      = false,
+                beginIP      = false;
 
     if (arg[0] == '-') {
         ports = false;
         delay = false;
         output = false;
+        targets = false;
+        daemon = false;
+        submit = false;
+        priority = false;
+        rate = false;
+        concurrency = false;
+        retries = false;
+        backend = false;
+        simConfig = false;
+        seed = false;
+        sample = false;
+        sampleCi = false;
+        samplePrefix = false;
+        blockPrefix = false;
+        deadAfter = false;
+        maxPerHost = false;
+        maxPerBlock = false;
+        portOrder = false;
+        resolve = false;
     }
 
     if (
@@ -163,6 +359,72 @@ void parseArgument(const char * arg) {
             case 'l':
                 printLicenseAndExit();
                 break;
+            case 'u':
+                options.udp = true;
+                break;
+            case 't':
+                targets = true;
+                break;
+            case 'S':
+                daemon = true;
+                break;
+            case 's':
+                submit = true;
+                break;
+            case 'P':
+                priority = true;
+                break;
+            case 'r':
+                rate = true;
+                break;
+            case 'c':
+                concurrency = true;
+                break;
+            case 'R':
+                retries = true;
+                break;
+            case 'B':
+                backend = true;
+                break;
+            case 'C':
+                simConfig = true;
+                break;
+            case 'E':
+                seed = true;
+                break;
+            case 'f':
+                sample = true;
+                break;
+            case 'I':
+                sampleCi = true;
+                break;
+            case 'L':
+                samplePrefix = true;
+                break;
+            case 'k':
+                blockPrefix = true;
+                break;
+            case 'A':
+                deadAfter = true;
+                break;
+            case 'H':
+                maxPerHost = true;
+                break;
+            case 'K':
+                maxPerBlock = true;
+                break;
+            case 'O':
+                portOrder = true;
+                break;
+            case 'T':
+                options.profileReport = true;
+                break;
+            case 'N':
+                resolve = true;
+                break;
+            case '6':
+                options.ipv6 = true;
+                break;
             default:
                 unknownOption(arg, true);
                 break;
@@ -180,18 +442,45 @@ void parseArgument(const char * arg) {
             return;
         }
 
-        static const char * availableArgs = "print-boo" "delay" "debug" "help" "output" "ports" "license";
+        static const char * availableArgs =
+            "print-boo" "delay" "debug" "help" "output" "ports" "license"
+            "daemon" "submit" "priority" "rate" "concurrency" "targets" "udp"
+            "retries" "backend" "sim-config" "seed" "sample" "sample-until-ci" "sample-prefix"
+            "dead-after" "block-prefix" "max-per-host" "max-per-block"
+            "port-order" "profile-report" "resolve" "ipv6";
         arg += 2;
 
         static enum {
-            UNKNOWN   = -1,
-            PRINT_BOO = 0,
-            DELAY     = 9,
-            DEBUG     = 14,
-            HELP      = 19,
-            OUTPUT    = 23,
-            PORTS     = 29,
-            LICENSE   = 34
+            UNKNOWN        = -1,
+            PRINT_BOO      = 0,
+            DELAY          = 9,
+            DEBUG          = 14,
+            HELP           = 19,
+            OUTPUT         = 23,
+            PORTS          = 29,
+            LICENSE        = 34,
+            DAEMON         = 41,
+            SUBMIT         = 47,
+            PRIORITY       = 53,
+            RATE           = 61,
+            CONCURRENCY    = 65,
+            TARGETS        = 76,
+            UDP            = 83,
+            RETRIES        = 86,
+            BACKEND        = 93,
+            SIM_CONFIG     = 100,
+            SEED           = 110,
+            SAMPLE         = 114,
+            SAMPLE_CI      = 120,
+            SAMPLE_PREFIX  = 135,
+            DEAD_AFTER     = 148,
+            BLOCK_PREFIX   = 158,
+            MAX_PER_HOST   = 170,
+            MAX_PER_BLOCK  = 182,
+            PORT_ORDER     = 195,
+            PROFILE_REPORT = 205,
+            RESOLVE        = 219,
+            IPV6           = 226
         } option;
         option = strstri(availableArgs, arg);
 
@@ -218,6 +507,72 @@ void parseArgument(const char * arg) {
         case LICENSE:
             printLicenseAndExit();
             break;
+        case DAEMON:
+            daemon = true;
+            break;
+        case SUBMIT:
+            submit = true;
+            break;
+        case PRIORITY:
+            priority = true;
+            break;
+        case RATE:
+            rate = true;
+            break;
+        case CONCURRENCY:
+            concurrency = true;
+            break;
+        case TARGETS:
+            targets = true;
+            break;
+        case UDP:
+            options.udp = true;
+            break;
+        case RETRIES:
+            retries = true;
+            break;
+        case BACKEND:
+            backend = true;
+            break;
+        case SIM_CONFIG:
+            simConfig = true;
+            break;
+        case SEED:
+            seed = true;
+            break;
+        case SAMPLE:
+            sample = true;
+            break;
+        case SAMPLE_CI:
+            sampleCi = true;
+            break;
+        case SAMPLE_PREFIX:
+            samplePrefix = true;
+            break;
+        case DEAD_AFTER:
+            deadAfter = true;
+            break;
+        case BLOCK_PREFIX:
+            blockPrefix = true;
+            break;
+        case MAX_PER_HOST:
+            maxPerHost = true;
+            break;
+        case MAX_PER_BLOCK:
+            maxPerBlock = true;
+            break;
+        case PORT_ORDER:
+            portOrder = true;
+            break;
+        case PROFILE_REPORT:
+            options.profileReport = true;
+            break;
+        case RESOLVE:
+            resolve = true;
+            break;
+        case IPV6:
+            options.ipv6 = true;
+            break;
         default:
             unknownOption(arg - 2, false);
             break;
@@ -236,34 +591,208 @@ void parseArgument(const char * arg) {
     }
 
     if (ports) {
-        sscanf(arg, "%hu", & options.ports[options.portsLen++]);
+        parsePorts(arg);
         return;
     }
 
     if (delay) {
-        sscanf(arg, "%u", & options.delay);
+        if (sscanf(arg, "%u", & options.delay) != 1 || options.delay > MAX_DELAY) {
+            fprintf(stderr, "ERROR: Invalid delay \"%s\"\n", arg);
+            exit(1);
+        }
 
         delay = false;
         return;
     }
 
     if (output) {
-        static size_t s;
-        s = strlen(arg) + 1;
-
-        options.output = malloc(s);
-        strncpy(options.output, arg, s);
+        options.output = copyString(arg);
 
         output = false;
         return;
     }
 
+    if (retries) {
+        sscanf(arg, "%u", & options.retries);
+
+        retries = false;
+        return;
+    }
+
+    if (backend) {
+        options.backend = copyString(arg);
+
+        backend = false;
+        return;
+    }
+
+    if (simConfig) {
+        options.simConfig = copyString(arg);
+
+        simConfig = false;
+        return;
+    }
+
+    if (seed) {
+        sscanf(arg, "%u", & options.seed);
+
+        seed = false;
+        return;
+    }
+
+    if (sample) {
+        sscanf(arg, "%lf", & options.sample);
+
+        if (options.sample < 0 || options.sample > 1) {
+            fprintf(stderr, "ERROR: Sample share must be from 0 to 1\n");
+            exit(1);
+        }
+
+        sample = false;
+        return;
+    }
+
+    if (sampleCi) {
+        sscanf(arg, "%lf", & options.sampleCi);
+
+        sampleCi = false;
+        return;
+    }
+
+    if (samplePrefix) {
+        sscanf(arg, "%u", & options.samplePrefix);
+
+        if (options.samplePrefix > 32) {
+            options.samplePrefix = 32;
+        }
+
+        samplePrefix = false;
+        return;
+    }
+
+    if (blockPrefix) {
+        sscanf(arg, "%u", & options.blockPrefix);
+
+        if (options.blockPrefix > 32) {
+            options.blockPrefix = 32;
+        }
+
+        blockPrefix = false;
+        return;
+    }
+
+    if (deadAfter) {
+        sscanf(arg, "%u", & options.deadAfter);
+
+        deadAfter = false;
+        return;
+    }
+
+    if (maxPerHost) {
+        sscanf(arg, "%u", & options.maxPerHost);
+
+        maxPerHost = false;
+        return;
+    }
+
+    if (maxPerBlock) {
+        sscanf(arg, "%u", & options.maxPerBlock);
+
+        maxPerBlock = false;
+        return;
+    }
+
+    if (portOrder) {
+        if (strcmp(arg, "given") == 0) {
+            options.portOrder = PORT_ORDER_GIVEN;
+        } else if (strcmp(arg, "probability") == 0) {
+            options.portOrder = PORT_ORDER_PROBABILITY;
+        } else if (strcmp(arg, "learned") == 0) {
+            options.portOrder = PORT_ORDER_LEARNED;
+        } else {
+            fprintf(stderr, "ERROR: Unknown port order \"%s\"\n", arg);
+            exit(1);
+        }
+
+        portOrder = false;
+        return;
+    }
+
+    if (resolve) {
+        options.resolve = copyString(arg);
+
+        resolve = false;
+        return;
+    }
+
+    if (targets) {
+        options.targets = copyString(arg);
+
+        targets = false;
+        return;
+    }
+
+    if (daemon) {
+        options.daemon = copyString(arg);
+
+        daemon = false;
+        return;
+    }
+
+    if (submit) {
+        options.submit = copyString(arg);
+
+        submit = false;
+        return;
+    }
+
+    if (priority) {
+        sscanf(arg, "%u", & options.priority);
+
+        if (options.priority == 0) {
+            options.priority = 1;
+        } else if (options.priority > MAX_PRIORITY) {
+            options.priority = MAX_PRIORITY;
+        }
+
+        priority = false;
+        return;
+    }
+
+    if (rate) {
+        sscanf(arg, "%u", & options.rate);
+
+        rate = false;
+        return;
+    }
+
+    if (concurrency) {
+        sscanf(arg, "%u", & options.concurrency);
+
+        if (options.concurrency == 0) {
+            options.concurrency = 1;
+        }
+
+        concurrency = false;
+        return;
+    }
+
+    static unsigned int range[2];
+    if (ipRangeParse(arg, arg + strlen(arg), range) != arg + strlen(arg)) {
+        fprintf(stderr, "ERROR: Invalid IP \"%s\"\n", arg);
+        exit(1);
+    }
+
     if (!beginIP) {
-        options.ipRange[0] = ipStrToNum(arg);
+        options.ipRange[0] = range[0];
+
+        if (strchr(arg, '/') != NULL) {
+            options.ipRange[1] = range[1];
+        }
 
         beginIP = true;
         return;
     }
 
-    options.ipRange[1] = ipStrToNum(arg);
+    options.ipRange[1] = range[0];
 }
@@ -24,18 +24,50 @@ SOFTWARE. */
 
 #include "bool.h"
 
-struct {
+/* Longest connection waiting time, seconds, so that it fits in milliseconds */
+#define MAX_DELAY 3600
+
+enum portOrder {
+    PORT_ORDER_GIVEN,
+    PORT_ORDER_PROBABILITY,
+    PORT_ORDER_LEARNED
+};
+
+extern struct options {
     unsigned short * ports;
     unsigned int * ipRange;
 
     char * output;
+    char * targets;
+    char * daemon;
+    char * submit;
+    char * backend;
+    char * simConfig;
+    char * resolve;
 
     unsigned int delay;
+    unsigned int priority;
+    unsigned int rate;
+    unsigned int concurrency;
+    unsigned int retries;
+    unsigned int seed;
+    unsigned int samplePrefix;
+    unsigned int blockPrefix;
+    unsigned int deadAfter;
+    unsigned int maxPerHost;
+    unsigned int maxPerBlock;
+
+    double sample;
+    double sampleCi;
 
     unsigned short portsLen;
+    enum portOrder portOrder;
 
     bool printBoo;
     bool debug;
+    bool udp;
+    bool profileReport;
+    bool ipv6;
 } options;
 
 extern void initOptions(const char * path);
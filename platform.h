@@ -40,4 +40,10 @@ SOFTWARE. */
 
 #include "bool.h"
 
+#ifdef _WIN32
+extern int setSocketNonBlock(SOCKET sock);
+
 extern bool checkConnection(unsigned int ip, unsigned int port);
+#else
+extern int setSocketNonBlock(int sock);
+#endif
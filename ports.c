@@ -0,0 +1,85 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#include "ports.h"
+
+#include "global.h"
+
+#define TOP_PORTS_LEN (sizeof(topPorts) / sizeof(topPorts[0]))
+
+/* TCP ports by open frequency in Internet scans (nmap-services), most frequent first */
+static const unsigned short topPorts[] = {
+    80, 23, 443, 21, 22, 25, 3389, 110, 445, 139,
+    143, 53, 135, 3306, 8080, 1723, 111, 995, 993, 5900,
+    1025, 587, 8888, 199, 1720, 465, 548, 113, 81, 6001,
+    10000, 514, 5060, 179, 1026, 2000, 8443, 8000, 32768, 554,
+    26, 1433, 49152, 2001, 515, 8008, 49154, 1027, 5666, 646,
+    5000, 5631, 631, 49153, 8081, 2049, 88, 79, 5800, 106,
+    2121, 1110, 49155, 6000, 513, 990, 5357, 427, 49156, 543,
+    544, 5101, 144, 7, 389, 8009, 3128, 444, 9999, 5009,
+    7070, 5190, 3000, 5432, 1900, 3986, 13, 1029, 9, 5051,
+    6646, 49157, 1028, 873, 1755, 2717, 4899, 9100, 119, 37
+};
+
+const unsigned short * findTopPorts(const char * name, unsigned int * count) {
+    char * end;
+
+    if (strncmp(name, "top", 3) != 0 || name[3] < '0' || name[3] > '9') {
+        return NULL;
+    }
+
+    unsigned long n = strtoul(name + 3, & end, 10);
+    if (* end != '\0' || n == 0 || n > TOP_PORTS_LEN) {
+        return NULL;
+    }
+
+    * count = n;
+    return topPorts;
+}
+
+unsigned int sortPortsByFrequency(unsigned short * ports, unsigned int portsLen) {
+    static bool present[65536];
+    static unsigned short sorted[65536];
+    unsigned int sortedLen = 0;
+
+    for (unsigned int i = 0; i < portsLen; ++i) {
+        present[ports[i]] = true;
+    }
+
+    for (unsigned int i = 0; i < TOP_PORTS_LEN; ++i) {
+        if (present[topPorts[i]]) {
+            present[topPorts[i]] = false;
+            sorted[sortedLen++] = topPorts[i];
+        }
+    }
+
+    for (unsigned int i = 0; i < portsLen; ++i) {
+        if (present[ports[i]]) {
+            present[ports[i]] = false;
+            sorted[sortedLen++] = ports[i];
+        }
+    }
+
+    memcpy(ports, sorted, sortedLen * sizeof(unsigned short));
+    return sortedLen;
+}
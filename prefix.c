@@ -0,0 +1,542 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#include "prefix.h"
+
+#include "options.h"
+#include "global.h"
+
+#define PREFIX_TABLE_SIZE 1024
+
+enum prefixVerdict {
+    PREFIX_UNKNOWN,
+    PREFIX_LIVE,
+    PREFIX_DEAD
+};
+
+/* Addresses first to last of a block left to probe */
+struct prefixRun {
+    unsigned int first, last;
+};
+
+struct prefixState {
+    unsigned int prefix;
+    enum prefixVerdict verdict;
+
+    struct prefixRun * runs;
+    struct prefixRun run;
+    unsigned int runsIdx, runsLen, runsCap;
+
+    unsigned int sent, timeouts, inFlight;
+    unsigned long long probeTime;
+
+    struct listNode node;
+};
+
+static unsigned int prefixOf(struct prefixQueue * queue, unsigned int ip) {
+    return queue->shift < 32 ? ip >> queue->shift : 0;
+}
+
+static unsigned int hashPrefix(struct prefixQueue * queue, unsigned int prefix) {
+    return (prefix * 2654435761u) & queue->tableMask;
+}
+
+static void listMove(struct prefixState * state, struct list * list) {
+    if (state->node.list != NULL) {
+        listRemove(& state->node);
+        listAppend(list, & state->node);
+    }
+}
+
+static struct list * verdictList(struct prefixQueue * queue, struct prefixState * state) {
+    switch (state->verdict) {
+    case PREFIX_LIVE:
+        return & queue->live;
+    case PREFIX_DEAD:
+        return & queue->dead;
+    default:
+        return queue->deadAfter > 0 && state->sent >= queue->deadAfter ? & queue->blocked : & queue->unknown;
+    }
+}
+
+static unsigned int tableFind(struct prefixQueue * queue, unsigned int prefix) {
+    unsigned int i = hashPrefix(queue, prefix);
+
+    while (queue->table[i] != NULL && queue->table[i]->prefix != prefix) {
+        i = (i + 1) & queue->tableMask;
+    }
+
+    return i;
+}
+
+static void tableGrow(struct prefixQueue * queue) {
+    struct prefixState ** table = queue->table;
+    unsigned int size = queue->tableMask + 1;
+
+    queue->table = calloc(size * 2, sizeof(struct prefixState *));
+    if (queue->table == NULL) {
+        __error("calloc");
+    }
+
+    queue->tableMask = size * 2 - 1;
+
+    for (unsigned int i = 0; i < size; ++i) {
+        if (table[i] != NULL) {
+            queue->table[tableFind(queue, table[i]->prefix)] = table[i];
+        }
+    }
+
+    free(table);
+}
+
+static unsigned int stateHome(const void * entry, void * queue) {
+    const struct prefixState * state = * (struct prefixState * const *) entry;
+
+    return state != NULL ? hashPrefix(queue, state->prefix) : TABLE_EMPTY;
+}
+
+static void tableRemove(struct prefixQueue * queue, unsigned int i) {
+    tableRemoveAt(queue->table, sizeof(struct prefixState *), queue->tableMask, i, stateHome, queue);
+    --queue->tableLen;
+}
+
+static struct prefixState * findState(struct prefixQueue * queue, unsigned int ip) {
+    return queue->table[tableFind(queue, prefixOf(queue, ip))];
+}
+
+static void freeState(struct prefixQueue * queue, struct prefixState * state) {
+    tableRemove(queue, tableFind(queue, state->prefix));
+
+    if (state->runs != & state->run) {
+        free(state->runs);
+    }
+
+    free(state);
+}
+
+static void addRun(struct prefixState * state, unsigned int first, unsigned int last) {
+    if (state->runsLen > 0) {
+        struct prefixRun * run = & state->runs[state->runsLen - 1];
+
+        if (run->last != 4294967295u && run->last + 1 == first) {
+            run->last = last;
+            return;
+        }
+    }
+
+    if (state->runsLen == state->runsCap) {
+        struct prefixRun * runs = malloc(state->runsCap * 2 * sizeof(struct prefixRun));
+        if (runs == NULL) {
+            __error("malloc");
+        }
+
+        memcpy(runs, state->runs, state->runsLen * sizeof(struct prefixRun));
+
+        if (state->runs != & state->run) {
+            free(state->runs);
+        }
+
+        state->runs = runs;
+        state->runsCap *= 2;
+    }
+
+    state->runs[state->runsLen].first = first;
+    state->runs[state->runsLen].last = last;
+    ++state->runsLen;
+}
+
+/* Moves the addresses left of a demoted block to the dead runs */
+static void spillState(struct prefixQueue * queue, struct prefixState * state) {
+    unsigned int len = state->runsLen - state->runsIdx;
+
+    if (queue->deadLen + len > queue->deadCap) {
+        queue->deadCap = queue->deadCap * 2 > queue->deadLen + len ? queue->deadCap * 2 : queue->deadLen + len;
+
+        queue->deadRuns = realloc(queue->deadRuns, queue->deadCap * sizeof(struct prefixRun));
+        if (queue->deadRuns == NULL) {
+            __error("realloc");
+        }
+    }
+
+    memcpy(& queue->deadRuns[queue->deadLen], & state->runs[state->runsIdx], len * sizeof(struct prefixRun));
+    queue->deadLen += len;
+
+    if (state->runs != & state->run) {
+        free(state->runs);
+    }
+
+    state->runs = & state->run;
+    state->runsIdx = 0;
+    state->runsLen = 0;
+    state->runsCap = 1;
+
+    if (state->node.list != NULL) {
+        listRemove(& state->node);
+    }
+}
+
+/* Takes the runs of the next spilled block back into its state on the dead list,
+   returns false if there are none */
+static bool restoreDead(struct prefixQueue * queue) {
+    if (queue->deadIdx == queue->deadLen) {
+        return false;
+    }
+
+    unsigned int prefix = prefixOf(queue, queue->deadRuns[queue->deadIdx].first);
+    unsigned int i = tableFind(queue, prefix);
+    struct prefixState * state = queue->table[i];
+
+    /* Its state is still there while its last probes are in flight */
+    if (state == NULL) {
+        state = calloc(1, sizeof(struct prefixState));
+        if (state == NULL) {
+            __error("calloc");
+        }
+
+        state->prefix = prefix;
+        state->verdict = PREFIX_DEAD;
+        state->runs = & state->run;
+        state->runsCap = 1;
+
+        queue->table[i] = state;
+
+        if (++queue->tableLen * 2 > queue->tableMask + 1) {
+            tableGrow(queue);
+        }
+    }
+
+    while (queue->deadIdx < queue->deadLen && prefixOf(queue, queue->deadRuns[queue->deadIdx].first) == prefix) {
+        addRun(state, queue->deadRuns[queue->deadIdx].first, queue->deadRuns[queue->deadIdx].last);
+        ++queue->deadIdx;
+    }
+
+    if (queue->deadIdx == queue->deadLen) {
+        free(queue->deadRuns);
+
+        queue->deadRuns = NULL;
+        queue->deadIdx = 0;
+        queue->deadLen = 0;
+        queue->deadCap = 0;
+    }
+
+    if (state->node.list == NULL) {
+        listAppend(verdictList(queue, state), & state->node);
+    }
+
+    return true;
+}
+
+static bool takeTarget(struct prefixQueue * queue, struct targets * targets, unsigned int * ip) {
+    if (queue->hasLookahead) {
+        queue->hasLookahead = false;
+        * ip = queue->lookahead;
+        return true;
+    }
+
+    if (queue->more) {
+        queue->more = targetsNextIP(targets, ip);
+    }
+
+    return queue->more;
+}
+
+/* Reads the targets up to the first address of a new block and the rest of its run,
+   returns false if no addresses were read */
+static bool pullPrefix(struct prefixQueue * queue, struct targets * targets) {
+    struct prefixState * added = NULL;
+    bool read = false;
+    unsigned int ip;
+
+    while (takeTarget(queue, targets, & ip)) {
+        unsigned int prefix = prefixOf(queue, ip);
+
+        if (added != NULL && added->prefix != prefix) {
+            queue->lookahead = ip;
+            queue->hasLookahead = true;
+            break;
+        }
+
+        unsigned int i = tableFind(queue, prefix);
+        struct prefixState * state = queue->table[i];
+
+        if (state == NULL) {
+            state = calloc(1, sizeof(struct prefixState));
+            if (state == NULL) {
+                __error("calloc");
+            }
+
+            state->prefix = prefix;
+            state->verdict = PREFIX_UNKNOWN;
+            state->runs = & state->run;
+            state->runsCap = 1;
+
+            queue->table[i] = state;
+            ++queue->blocks;
+
+            if (++queue->tableLen * 2 > queue->tableMask + 1) {
+                tableGrow(queue);
+            }
+
+            added = state;
+        }
+
+        addRun(state, ip, ip);
+        read = true;
+
+        if (state->node.list == NULL) {
+            listAppend(verdictList(queue, state), & state->node);
+        }
+    }
+
+    return read;
+}
+
+static bool admitted(struct prefixQueue * queue, unsigned int ip) {
+    return queue->admit == NULL || queue->admit(ip);
+}
+
+/* Finds the first block of the list whose next address is admitted */
+static struct prefixState * findAdmitted(struct prefixQueue * queue, struct list * list) {
+    for (struct listNode * node = list->head; node != NULL; node = node->next) {
+        struct prefixState * state = listEntry(node, struct prefixState, node);
+
+        if (admitted(queue, state->runs[state->runsIdx].first)) {
+            return state;
+        }
+    }
+
+    return NULL;
+}
+
+static unsigned int takeAddress(struct prefixQueue * queue, struct prefixState * state) {
+    struct prefixRun * run = & state->runs[state->runsIdx];
+    unsigned int ip = run->first;
+
+    if (run->first++ == run->last && ++state->runsIdx == state->runsLen) {
+        state->runsIdx = 0;
+        state->runsLen = 0;
+    }
+
+    ++state->sent;
+    ++state->inFlight;
+
+    struct list * list = state->node.list;
+    listRemove(& state->node);
+
+    if (state->runsLen > 0) {
+        listAppend(list == & queue->unknown ? verdictList(queue, state) : list, & state->node);
+    }
+
+    return ip;
+}
+
+void prefixInit(
+    struct prefixQueue * queue, bool enabled, unsigned int prefixLen,
+    unsigned int deadAfter, unsigned int window, bool (* admit)(unsigned int ip)
+) {
+    memset(queue, 0, sizeof(struct prefixQueue));
+
+    queue->enabled = enabled;
+    queue->shift = 32 - (prefixLen > 32 ? 32 : prefixLen);
+    queue->deadAfter = deadAfter;
+    queue->window = window > 0 ? window : 1;
+    queue->admit = admit;
+    queue->more = true;
+
+    if (!enabled) {
+        return;
+    }
+
+    queue->table = calloc(PREFIX_TABLE_SIZE, sizeof(struct prefixState *));
+    if (queue->table == NULL) {
+        __error("calloc");
+    }
+
+    queue->tableMask = PREFIX_TABLE_SIZE - 1;
+}
+
+void prefixFree(struct prefixQueue * queue) {
+    if (queue->table == NULL) {
+        return;
+    }
+
+    for (unsigned int i = 0; i <= queue->tableMask; ++i) {
+        struct prefixState * state = queue->table[i];
+
+        if (state != NULL) {
+            if (state->runs != & state->run) {
+                free(state->runs);
+            }
+
+            free(state);
+        }
+    }
+
+    free(queue->table);
+    queue->table = NULL;
+
+    free(queue->deadRuns);
+    queue->deadRuns = NULL;
+}
+
+bool prefixNext(struct prefixQueue * queue, struct targets * targets, unsigned int * ip) {
+    if (!queue->enabled) {
+        if (!queue->hasLookahead) {
+            queue->hasLookahead = takeTarget(queue, targets, & queue->lookahead);
+        }
+
+        if (!queue->hasLookahead || !admitted(queue, queue->lookahead)) {
+            return false;
+        }
+
+        queue->hasLookahead = false;
+        * ip = queue->lookahead;
+        return true;
+    }
+
+    while (queue->live.len + queue->unknown.len + queue->blocked.len < queue->window) {
+        if (!pullPrefix(queue, targets)) {
+            break;
+        }
+    }
+
+    /* Every fourth address goes to a block not known yet while there are live ones */
+    bool preferLive = (++queue->turn & 3) != 0;
+
+    for (;;) {
+        struct prefixState * state = NULL;
+
+        if (preferLive || queue->unknown.len == 0) {
+            state = findAdmitted(queue, & queue->live);
+        }
+
+        if (state == NULL) {
+            state = findAdmitted(queue, & queue->unknown);
+        }
+
+        if (state == NULL && !preferLive) {
+            state = findAdmitted(queue, & queue->live);
+        }
+
+        /* Known blocks are busy or waiting for their results, read more of the targets meanwhile */
+        if (state == NULL && pullPrefix(queue, targets)) {
+            continue;
+        }
+
+        if (state == NULL) {
+            state = findAdmitted(queue, & queue->dead);
+        }
+
+        /* Tail pass, blocks of the dead list are busy or done */
+        if (state == NULL && queue->dead.len < queue->window && restoreDead(queue)) {
+            continue;
+        }
+
+        if (state == NULL) {
+            return false;
+        }
+
+        * ip = takeAddress(queue, state);
+        return true;
+    }
+}
+
+bool prefixDone(struct prefixQueue * queue) {
+    return !queue->hasLookahead && !queue->more && queue->deadLen == 0 &&
+        queue->live.len + queue->unknown.len + queue->blocked.len + queue->dead.len == 0;
+}
+
+void prefixProbe(struct prefixQueue * queue, unsigned int ip, unsigned int time) {
+    if (!queue->enabled) {
+        return;
+    }
+
+    struct prefixState * state = findState(queue, ip);
+    if (state == NULL) {
+        return;
+    }
+
+    queue->probeTime += time;
+
+    if (state->verdict == PREFIX_DEAD) {
+        queue->demotedTime += time;
+        queue->tailTime += time;
+    } else {
+        state->probeTime += time;
+    }
+}
+
+void prefixHost(struct prefixQueue * queue, unsigned int ip, bool answered) {
+    if (!queue->enabled) {
+        return;
+    }
+
+    struct prefixState * state = findState(queue, ip);
+    if (state == NULL) {
+        return;
+    }
+
+    --state->inFlight;
+
+    if (answered) {
+        if (state->verdict == PREFIX_DEAD) {
+            ++queue->tailHosts;
+        }
+
+        state->verdict = PREFIX_LIVE;
+        listMove(state, & queue->live);
+    } else if (
+        state->verdict == PREFIX_UNKNOWN &&
+        queue->deadAfter > 0 &&
+        ++state->timeouts >= queue->deadAfter
+    ) {
+        state->verdict = PREFIX_DEAD;
+        spillState(queue, state);
+
+        ++queue->demoted;
+        queue->demotedTime += state->probeTime;
+    }
+
+    if (state->node.list == NULL && state->inFlight == 0) {
+        freeState(queue, state);
+    }
+}
+
+void prefixReport(struct prefixQueue * queue) {
+    if (!queue->enabled || queue->deadAfter == 0) {
+        return;
+    }
+
+    /* Scans without a dead block stay quiet unless asked */
+    if (queue->demoted == 0 && !options.debug && !options.profileReport) {
+        return;
+    }
+
+    fprintf(
+        stderr, "Blocks: %llu of %llu demoted, %.1f of %.1f sec of probe time (%.1f%%) spent on them,\n"
+        "  %.1f sec in the tail pass with %llu answered hosts\n",
+        queue->demoted, queue->blocks, queue->demotedTime / 1000.0, queue->probeTime / 1000.0,
+        queue->probeTime > 0 ? 100.0 * queue->demotedTime / queue->probeTime : 0.0,
+        queue->tailTime / 1000.0, queue->tailHosts
+    );
+}
@@ -0,0 +1,81 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#pragma once
+
+#include "targets.h"
+#include "util.h"
+#include "bool.h"
+
+struct prefixState;
+struct prefixRun;
+
+/* Interleaves the addresses of a job over blocks of the range, learning which blocks are live:
+   a block whose first deadAfter hosts all timed out is demoted to a tail pass, a block with
+   any answered probe is preferred to the blocks not known yet */
+struct prefixQueue {
+    bool enabled;
+
+    unsigned int shift;
+    unsigned int deadAfter;
+    unsigned int window;
+
+    /* Tells if an address may be probed now, may be NULL */
+    bool (* admit)(unsigned int ip);
+
+    /* Open addressing table of blocks having addresses or hosts in flight */
+    struct prefixState ** table;
+    unsigned int tableMask, tableLen;
+
+    struct list live, unknown, blocked, dead;
+    unsigned int turn;
+
+    /* Addresses left of demoted blocks, restored to the dead list a window of blocks at a time
+       by the tail pass, so they don't keep their state meanwhile */
+    struct prefixRun * deadRuns;
+    unsigned int deadIdx, deadLen, deadCap;
+
+    unsigned int lookahead;
+    bool hasLookahead, more;
+
+    /* Probe time statistics, ms */
+    unsigned long long probeTime, demotedTime, tailTime;
+    unsigned long long blocks, demoted, tailHosts;
+};
+
+extern void prefixInit(
+    struct prefixQueue * queue, bool enabled, unsigned int prefixLen,
+    unsigned int deadAfter, unsigned int window, bool (* admit)(unsigned int ip)
+);
+extern void prefixFree(struct prefixQueue * queue);
+
+/* Takes the next admitted address to probe from the known blocks or the targets,
+   returns false if none is available until some hosts are done */
+extern bool prefixNext(struct prefixQueue * queue, struct targets * targets, unsigned int * ip);
+extern bool prefixDone(struct prefixQueue * queue);
+
+/* Tells the probe time of an address and that its host is done */
+extern void prefixProbe(struct prefixQueue * queue, unsigned int ip, unsigned int time);
+extern void prefixHost(struct prefixQueue * queue, unsigned int ip, bool answered);
+
+extern void prefixReport(struct prefixQueue * queue);
@@ -0,0 +1,93 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "ratelimit.h"
+
+#include <time.h>
+
+long long nowMs(void) {
+    static struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, & ts);
+
+    return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void refill(struct rateLimit * limit) {
+    long long now = limit->now();
+    double burst = limit->rate / 10 > 0 ? limit->rate / 10 : 1;
+
+    limit->tokens += (double) limit->rate * (now - limit->last) / 1000;
+    if (limit->tokens > burst) {
+        limit->tokens = burst;
+    }
+
+    limit->last = now;
+}
+
+void rateLimitInit(struct rateLimit * limit, unsigned int rate, long long (* now)(void)) {
+    limit->now = now;
+    limit->rate = rate;
+    limit->tokens = 1;
+    limit->last = now();
+}
+
+unsigned int rateLimitTake(struct rateLimit * limit, unsigned int count) {
+    if (limit->rate == 0) {
+        return count;
+    }
+
+    refill(limit);
+
+    if (limit->tokens < count) {
+        count = (unsigned int) limit->tokens;
+    }
+
+    limit->tokens -= count;
+    return count;
+}
+
+void rateLimitReturn(struct rateLimit * limit, unsigned int count) {
+    if (limit->rate != 0) {
+        limit->tokens += count;
+    }
+}
+
+int rateLimitWait(struct rateLimit * limit) {
+    if (limit->rate == 0) {
+        return 0;
+    }
+
+    refill(limit);
+
+    if (limit->tokens >= 1) {
+        return 0;
+    }
+
+    return (int) ((1 - limit->tokens) * 1000 / limit->rate) + 1;
+}
+
+#endif
@@ -0,0 +1,514 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "resolve.h"
+
+#include <poll.h>
+
+#include "platform.h"
+
+#include "ratelimit.h"
+#include "global.h"
+#include "main.h"
+#include "util.h"
+
+#define RESOLVE_CACHE_SIZE 4096
+#define RESOLVE_IN_FLIGHT 256
+#define RESOLVE_TIMEOUT 2000
+#define RESOLVE_ATTEMPTS 3
+
+#define DNS_HEADER_LEN 12
+#define DNS_TYPE_PTR 12
+#define DNS_CLASS_IN 1
+
+struct resolveWaiter {
+    unsigned short port;
+    struct resolveWaiter * next;
+};
+
+/* Cached name or a lookup waiting in the queue or in flight */
+struct resolveEntry {
+    unsigned int ip;
+    char * name;
+    bool done;
+
+    struct resolveWaiter * waiters;
+    unsigned short id;
+    unsigned int attempts;
+    long long deadline;
+
+    struct listNode node;
+};
+
+static int sock = -1;
+
+static struct resolveEntry ** table = NULL;
+static unsigned int tableMask = 0, tableLen = 0;
+
+/* Done entries from the most recently used, lookups in sending order */
+static struct list cache, queue, inFlight;
+
+static struct resolveEntry * byId[65536];
+static unsigned short nextId;
+
+static struct resolveEntry * headEntry(struct list * list) {
+    return list->head != NULL ? listEntry(list->head, struct resolveEntry, node) : NULL;
+}
+
+static unsigned int hashIP(unsigned int ip) {
+    return (ip * 2654435761u) & tableMask;
+}
+
+static unsigned int tableFind(unsigned int ip) {
+    unsigned int i = hashIP(ip);
+
+    while (table[i] != NULL && table[i]->ip != ip) {
+        i = (i + 1) & tableMask;
+    }
+
+    return i;
+}
+
+static void tableGrow(void) {
+    struct resolveEntry ** old = table;
+    unsigned int size = tableMask + 1;
+
+    table = calloc(size * 2, sizeof(struct resolveEntry *));
+    if (table == NULL) {
+        __error("calloc");
+    }
+
+    tableMask = size * 2 - 1;
+
+    for (unsigned int i = 0; i < size; ++i) {
+        if (old[i] != NULL) {
+            table[tableFind(old[i]->ip)] = old[i];
+        }
+    }
+
+    free(old);
+}
+
+static unsigned int entryHome(const void * entry, void * ctx) {
+    const struct resolveEntry * resolveEntry = * (struct resolveEntry * const *) entry;
+
+    return resolveEntry != NULL ? hashIP(resolveEntry->ip) : TABLE_EMPTY;
+}
+
+static void tableRemove(unsigned int i) {
+    tableRemoveAt(table, sizeof(struct resolveEntry *), tableMask, i, entryHome, NULL);
+    --tableLen;
+}
+
+/* Writes the d.c.b.a.in-addr.arpa name of ip in the DNS wire format, returns its length */
+static unsigned int reverseName(unsigned int ip, unsigned char * dst) {
+    unsigned int len = 0;
+
+    for (unsigned int i = 0; i < 4; ++i) {
+        unsigned int octet = (ip >> (i * 8)) & 0xff;
+        unsigned char * label = & dst[len++];
+
+        if (octet >= 100) {
+            dst[len++] = '0' + octet / 100;
+        }
+
+        if (octet >= 10) {
+            dst[len++] = '0' + octet / 10 % 10;
+        }
+
+        dst[len++] = '0' + octet % 10;
+        * label = & dst[len] - label - 1;
+    }
+
+    memcpy(& dst[len], "\x07" "in-addr" "\x04" "arpa", 13);
+    return len + 13;
+}
+
+static void sendQuery(struct resolveEntry * entry) {
+    static unsigned char packet[DNS_HEADER_LEN + 32 + 4];
+
+    memset(packet, 0, DNS_HEADER_LEN);
+
+    packet[0] = entry->id >> 8;
+    packet[1] = entry->id & 0xff;
+    packet[2] = 0x01;
+    packet[5] = 1;
+
+    unsigned int len = DNS_HEADER_LEN + reverseName(entry->ip, & packet[DNS_HEADER_LEN]);
+
+    packet[len++] = 0;
+    packet[len++] = DNS_TYPE_PTR;
+    packet[len++] = 0;
+    packet[len++] = DNS_CLASS_IN;
+
+    if (send(sock, packet, len, 0) == -1 && errno != EAGAIN && errno != ECONNREFUSED) {
+        __error("send");
+    }
+
+    ++entry->attempts;
+    entry->deadline = nowMs() + RESOLVE_TIMEOUT;
+}
+
+static void sendQueue(void) {
+    while (queue.head != NULL && inFlight.len < RESOLVE_IN_FLIGHT) {
+        struct resolveEntry * entry = headEntry(& queue);
+
+        do {
+            nextId = nextId * 25173 + 13849;
+        } while (byId[nextId] != NULL);
+
+        entry->id = nextId;
+        byId[nextId] = entry;
+
+        listRemove(& entry->node);
+        listAppend(& inFlight, & entry->node);
+
+        sendQuery(entry);
+    }
+}
+
+static void finish(struct resolveEntry * entry, char * name) {
+    byId[entry->id] = NULL;
+
+    entry->name = name;
+    entry->done = true;
+
+    listRemove(& entry->node);
+    listPrepend(& cache, & entry->node);
+
+    while (entry->waiters != NULL) {
+        struct resolveWaiter * waiter = entry->waiters;
+        entry->waiters = waiter->next;
+
+        printHitName(entry->ip, waiter->port, name);
+        free(waiter);
+    }
+
+    if (cache.len > RESOLVE_CACHE_SIZE) {
+        struct resolveEntry * last = listEntry(cache.tail, struct resolveEntry, node);
+
+        listRemove(& last->node);
+        tableRemove(tableFind(last->ip));
+
+        free(last->name);
+        free(last);
+    }
+}
+
+/* Skips a possibly compressed name, returns the offset past it or 0 if it's malformed */
+static unsigned int skipName(const unsigned char * packet, unsigned int len, unsigned int pos) {
+    while (pos < len) {
+        if (packet[pos] == 0) {
+            return pos + 1;
+        }
+
+        if ((packet[pos] & 0xc0) == 0xc0) {
+            return pos + 2 <= len ? pos + 2 : 0;
+        }
+
+        pos += packet[pos] + 1;
+    }
+
+    return 0;
+}
+
+/* Decodes a name following compression pointers into dotted text, returns false if it's malformed */
+static bool readName(const unsigned char * packet, unsigned int len, unsigned int pos, char * dst) {
+    unsigned int dstLen = 0, jumps = 0;
+
+    while (pos < len) {
+        unsigned int label = packet[pos];
+
+        if (label == 0) {
+            if (dstLen == 0) {
+                dst[dstLen++] = '.';
+            }
+
+            dst[dstLen] = '\0';
+            return true;
+        }
+
+        if ((label & 0xc0) == 0xc0) {
+            if (pos + 1 >= len || ++jumps > 16) {
+                return false;
+            }
+
+            pos = ((label & 0x3f) << 8) | packet[pos + 1];
+            continue;
+        }
+
+        if (pos + 1 + label > len || dstLen + label + 1 > 254) {
+            return false;
+        }
+
+        if (dstLen > 0) {
+            dst[dstLen++] = '.';
+        }
+
+        memcpy(& dst[dstLen], & packet[pos + 1], label);
+        dstLen += label;
+        pos += label + 1;
+    }
+
+    return false;
+}
+
+static void handleReply(const unsigned char * packet, unsigned int len) {
+    if (len < DNS_HEADER_LEN || !(packet[2] & 0x80)) {
+        return;
+    }
+
+    struct resolveEntry * entry = byId[(packet[0] << 8) | packet[1]];
+    if (entry == NULL) {
+        return;
+    }
+
+    /* The question must be the one sent */
+    static unsigned char question[32];
+    unsigned int questionLen = reverseName(entry->ip, question);
+
+    if (
+        ((packet[4] << 8) | packet[5]) != 1 ||
+        len < DNS_HEADER_LEN + questionLen + 4 ||
+        memcmp(& packet[DNS_HEADER_LEN], question, questionLen) != 0
+    ) {
+        return;
+    }
+
+    unsigned int rcode = packet[3] & 0x0f;
+    unsigned int answers = (packet[6] << 8) | packet[7];
+    unsigned int pos = DNS_HEADER_LEN + questionLen + 4;
+
+    if (rcode != 0 && rcode != 3) {
+        return;
+    }
+
+    for (unsigned int i = 0; rcode == 0 && i < answers; ++i) {
+        pos = skipName(packet, len, pos);
+
+        if (pos == 0 || pos + 10 > len) {
+            break;
+        }
+
+        unsigned int type = (packet[pos] << 8) | packet[pos + 1];
+        unsigned int class = (packet[pos + 2] << 8) | packet[pos + 3];
+        unsigned int dataLen = (packet[pos + 8] << 8) | packet[pos + 9];
+
+        pos += 10;
+
+        if (pos + dataLen > len) {
+            break;
+        }
+
+        static char name[256];
+        if (type == DNS_TYPE_PTR && class == DNS_CLASS_IN && readName(packet, len, pos, name)) {
+            char * copy = malloc(strlen(name) + 1);
+            if (copy == NULL) {
+                __error("malloc");
+            }
+
+            strcpy(copy, name);
+
+            finish(entry, copy);
+            return;
+        }
+
+        pos += dataLen;
+    }
+
+    finish(entry, NULL);
+}
+
+bool resolveInit(const char * resolver) {
+    const char * end = resolver + strlen(resolver);
+    unsigned int ip, port = 53;
+
+    const char * str = ipParse(resolver, end, & ip);
+    if (str != NULL && * str == ':') {
+        char * portEnd;
+        port = strtoul(str + 1, & portEnd, 10);
+
+        str = portEnd == str + 1 || port == 0 || port > 65535 ? NULL : portEnd;
+    }
+
+    if (str == NULL || str != end) {
+        fprintf(stderr, "ERROR: Invalid resolver \"%s\"\n", resolver);
+        return false;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock == -1) {
+        __error("socket");
+    }
+
+    if (setSocketNonBlock(sock) == -1) {
+        __error("setSocketNonBlock");
+    }
+
+    static struct sockaddr_in sockAddr;
+    memset(& sockAddr, 0, sizeof(sockAddr));
+
+    sockAddr.sin_family = PF_INET;
+    sockAddr.sin_port = htons(port);
+    ipNumToAddr(ip, & sockAddr.sin_addr);
+
+    if (connect(sock, (struct sockaddr *) & sockAddr, sizeof(sockAddr)) == -1) {
+        __error("connect");
+    }
+
+    table = calloc(RESOLVE_CACHE_SIZE * 2, sizeof(struct resolveEntry *));
+    if (table == NULL) {
+        __error("calloc");
+    }
+
+    tableMask = RESOLVE_CACHE_SIZE * 2 - 1;
+    nextId = nowMs();
+
+    return true;
+}
+
+void resolveHit(unsigned int ip, unsigned short port) {
+    unsigned int i = tableFind(ip);
+    struct resolveEntry * entry = table[i];
+
+    if (entry != NULL && entry->done) {
+        listRemove(& entry->node);
+        listPrepend(& cache, & entry->node);
+
+        printHitName(ip, port, entry->name);
+        return;
+    }
+
+    if (entry == NULL) {
+        entry = calloc(1, sizeof(struct resolveEntry));
+        if (entry == NULL) {
+            __error("calloc");
+        }
+
+        entry->ip = ip;
+        table[i] = entry;
+
+        if (++tableLen * 2 > tableMask + 1) {
+            tableGrow();
+        }
+
+        listAppend(& queue, & entry->node);
+    }
+
+    struct resolveWaiter * waiter = malloc(sizeof(struct resolveWaiter));
+    if (waiter == NULL) {
+        __error("malloc");
+    }
+
+    waiter->port = port;
+    waiter->next = NULL;
+
+    struct resolveWaiter ** link = & entry->waiters;
+    while (* link != NULL) {
+        link = & (* link)->next;
+    }
+
+    * link = waiter;
+
+    resolvePoll();
+}
+
+int resolveFd(int * timeout) {
+    if (inFlight.head == NULL) {
+        return -1;
+    }
+
+    long long remaining = headEntry(& inFlight)->deadline - nowMs();
+    if (remaining < 0) {
+        remaining = 0;
+    }
+
+    if (* timeout < 0 || remaining < * timeout) {
+        * timeout = remaining;
+    }
+
+    return sock;
+}
+
+void resolvePoll(void) {
+    static unsigned char packet[1500];
+
+    for (;;) {
+        ssize_t len = recv(sock, packet, sizeof(packet), 0);
+
+        if (len == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                break;
+            }
+
+            /* ICMP errors of the resolver are left to the query timeouts */
+            if (errno == ECONNREFUSED) {
+                continue;
+            }
+
+            __error("recv");
+        }
+
+        handleReply(packet, len);
+    }
+
+    long long now = nowMs();
+
+    /* Deadlines are in sending order */
+    while (inFlight.head != NULL && headEntry(& inFlight)->deadline <= now) {
+        struct resolveEntry * entry = headEntry(& inFlight);
+
+        if (entry->attempts >= RESOLVE_ATTEMPTS) {
+            finish(entry, NULL);
+            continue;
+        }
+
+        listRemove(& entry->node);
+        listAppend(& inFlight, & entry->node);
+
+        sendQuery(entry);
+    }
+
+    sendQueue();
+}
+
+void resolveFlush(void) {
+    while (queue.head != NULL || inFlight.head != NULL) {
+        struct pollfd fd = { sock, POLLIN, 0 };
+        int timeout = -1;
+
+        resolveFd(& timeout);
+
+        if (poll(& fd, 1, timeout) == -1 && errno != EINTR) {
+            __error("poll");
+        }
+
+        resolvePoll();
+    }
+}
+
+#endif
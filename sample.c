@@ -0,0 +1,285 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#include "sample.h"
+
+#include <math.h>
+
+#include "options.h"
+#include "global.h"
+#include "util.h"
+
+#define SAMPLE_Z 1.96
+#define SAMPLE_MIN 30
+#define SAMPLE_MAX_COUNTS (1 << 24)
+
+struct sampleCount {
+    unsigned int n;
+    unsigned int hits;
+};
+
+static struct targets * sampleTargets = NULL;
+
+static unsigned int range[2];
+static unsigned int shift, firstPrefix, prefixesLen;
+
+/* Results of hosts sampled after the first unfinished one, indexed from pendingBase */
+struct sampleHost {
+    unsigned int ip;
+    unsigned short done;
+};
+
+static struct sampleHost * pending = NULL;
+static unsigned long long * pendingBits = NULL;
+static unsigned long long pendingBase = 0;
+static unsigned int pendingCap = 0, pendingHead = 0, bitsStride = 0;
+
+static unsigned short portIndex[65536];
+static struct sampleCount * ports = NULL;
+static struct sampleCount * prefixes = NULL;
+
+static unsigned long long hosts = 0;
+
+bool sampleInit(struct targets * targets) {
+    unsigned int begin = targets->range[0], end = targets->range[1];
+    sampleTargets = targets;
+
+    if (end <= begin) {
+        fprintf(stderr, "ERROR: Empty range to sampling\n");
+        return false;
+    }
+
+    range[0] = begin;
+    range[1] = end;
+
+    shift = 32 - options.samplePrefix;
+    firstPrefix = shift < 32 ? begin >> shift : 0;
+    prefixesLen = (shift < 32 ? (end - 1) >> shift : 0) - firstPrefix + 1;
+
+    if ((unsigned long long) prefixesLen * options.portsLen > SAMPLE_MAX_COUNTS) {
+        fprintf(stderr, "ERROR: Too many blocks to sampling, use a shorter prefix\n");
+        return false;
+    }
+
+    for (unsigned int i = 0; i < options.portsLen; ++i) {
+        portIndex[options.ports[i]] = i;
+    }
+
+    ports = calloc(options.portsLen, sizeof(struct sampleCount));
+    prefixes = calloc((size_t) prefixesLen * options.portsLen, sizeof(struct sampleCount));
+
+    bitsStride = (options.portsLen + 63) / 64;
+    pendingCap = 1024;
+
+    pending = calloc(pendingCap, sizeof(struct sampleHost));
+    pendingBits = calloc((size_t) pendingCap * bitsStride, sizeof(unsigned long long));
+
+    if (ports == NULL || prefixes == NULL || pending == NULL || pendingBits == NULL) {
+        __error("calloc");
+    }
+
+    return true;
+}
+
+static void growPending(void) {
+    struct sampleHost * hosts = calloc(pendingCap * 2, sizeof(struct sampleHost));
+    unsigned long long * bits = calloc((size_t) pendingCap * 2 * bitsStride, sizeof(unsigned long long));
+
+    if (hosts == NULL || bits == NULL) {
+        __error("calloc");
+    }
+
+    for (unsigned int i = 0; i < pendingCap; ++i) {
+        unsigned int j = (pendingHead + i) % pendingCap;
+
+        hosts[i] = pending[j];
+        memcpy(bits + (size_t) i * bitsStride, pendingBits + (size_t) j * bitsStride, bitsStride * sizeof(unsigned long long));
+    }
+
+    free(pending);
+    free(pendingBits);
+
+    pending = hosts;
+    pendingBits = bits;
+    pendingHead = 0;
+    pendingCap *= 2;
+}
+
+static void countHost(struct sampleHost * host, unsigned long long * bits) {
+    unsigned int prefix = (shift < 32 ? host->ip >> shift : 0) - firstPrefix;
+
+    for (unsigned int i = 0; i < options.portsLen; ++i) {
+        bool open = (bits[i / 64] >> (i % 64)) & 1;
+
+        struct sampleCount * counts[] = {
+            & ports[i],
+            & prefixes[(size_t) prefix * options.portsLen + i]
+        };
+
+        for (unsigned int j = 0; j < 2; ++j) {
+            ++counts[j]->n;
+            counts[j]->hits += open;
+        }
+    }
+
+    ++hosts;
+}
+
+void sampleProbe(unsigned int ip, unsigned short port, enum probeStatus status) {
+    unsigned long long idx = targetsSampleIndex(sampleTargets, ip);
+
+    while (idx - pendingBase >= pendingCap) {
+        growPending();
+    }
+
+    unsigned int slot = (pendingHead + (idx - pendingBase)) % pendingCap;
+    unsigned int portIdx = portIndex[port];
+
+    pending[slot].ip = ip;
+    ++pending[slot].done;
+
+    if (status == PROBE_OPEN) {
+        pendingBits[(size_t) slot * bitsStride + portIdx / 64] |= 1ull << (portIdx % 64);
+    }
+
+    while (pending[pendingHead].done == options.portsLen) {
+        unsigned long long * bits = pendingBits + (size_t) pendingHead * bitsStride;
+
+        countHost(& pending[pendingHead], bits);
+
+        pending[pendingHead].done = 0;
+        memset(bits, 0, bitsStride * sizeof(unsigned long long));
+
+        pendingHead = (pendingHead + 1) % pendingCap;
+        ++pendingBase;
+    }
+}
+
+/* Wilson score interval of the share, the finite population correction enlarges
+   the effective sample size, so a full census collapses to the observed share */
+static void interval(const struct sampleCount * count, double population, double * low, double * high) {
+    double n = count->n, p = count->hits / n, z2 = SAMPLE_Z * SAMPLE_Z;
+
+    * low = * high = p;
+
+    if (population > 1) {
+        if (n >= population) {
+            return;
+        }
+
+        n *= (population - 1) / (population - n);
+    }
+
+    double denominator = 1 + z2 / n;
+    double center = (p + z2 / (2 * n)) / denominator;
+    double hw = SAMPLE_Z / denominator * sqrt(p * (1 - p) / n + z2 / (4 * n * n));
+
+    if (center - hw < * low) {
+        * low = center - hw < 0 ? 0 : center - hw;
+    }
+
+    if (center + hw > * high) {
+        * high = center + hw > 1 ? 1 : center + hw;
+    }
+}
+
+static void printEstimate(const struct sampleCount * count, double population) {
+    double low, high;
+    interval(count, population, & low, & high);
+
+    double share = (double) count->hits / count->n;
+
+    printf("~%.0f hosts, %.4f%% (95%% CI %.0f-%.0f, +- %.4f%%) of %.0f, %u sampled",
+        share * population, share * 100, low * population, high * population,
+        (high - low) / 2 * 100, population, count->n);
+}
+
+bool sampleEnough(void) {
+    double population = (double) range[1] - range[0], low, high;
+
+    for (unsigned int i = 0; i < options.portsLen; ++i) {
+        if (ports[i].n < SAMPLE_MIN) {
+            return false;
+        }
+
+        interval(& ports[i], population, & low, & high);
+
+        if ((high - low) / 2 > options.sampleCi) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+unsigned long long sampleHosts(void) {
+    return hosts;
+}
+
+void sampleReport(bool final) {
+    static char strIP[16];
+
+    if (hosts == 0) {
+        return;
+    }
+
+    printf("%s estimate after %llu hosts:\n", final ? "Final" : "Running", hosts);
+
+    for (unsigned int i = 0; i < options.portsLen; ++i) {
+        if (ports[i].n == 0) {
+            continue;
+        }
+
+        printf("  port %hu ", options.ports[i]);
+        printEstimate(& ports[i], (double) range[1] - range[0]);
+        printf("\n");
+    }
+
+    /* Blocks only go to the final report, a line per block and port every second would bury the ports */
+    if (!final) {
+        fflush(stdout);
+        return;
+    }
+
+    for (unsigned int prefix = 0; prefix < prefixesLen; ++prefix) {
+        unsigned int begin = shift < 32 ? (firstPrefix + prefix) << shift : 0;
+        unsigned long long end = shift < 32 ? (unsigned long long) begin + (1ull << shift) : 4294967296ull;
+
+        unsigned int first = begin > range[0] ? begin : range[0];
+        unsigned long long last = end < range[1] ? end : range[1];
+
+        ipNumToStr(begin, strIP);
+
+        for (unsigned int i = 0; i < options.portsLen; ++i) {
+            struct sampleCount * count = & prefixes[(size_t) prefix * options.portsLen + i];
+
+            if (count->n == 0) {
+                continue;
+            }
+
+            printf("  block %s/%u port %hu ", strIP, options.samplePrefix, options.ports[i]);
+            printEstimate(count, (double) (last - first));
+            printf("\n");
+        }
+    }
+}
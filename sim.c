@@ -0,0 +1,340 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <math.h>
+#include <poll.h>
+
+#include "backend.h"
+#include "ratelimit.h"
+#include "options.h"
+#include "global.h"
+#include "util.h"
+
+#define SIM_LIMITS (1 << 16)
+
+/* Model of the hosts in a block, the longest matching block wins */
+struct simRule {
+    unsigned int range[2];
+    unsigned int prefix;
+
+    double live;
+    double open;
+    double rtt;
+    double jitter;
+    double loss;
+
+    unsigned int limit;
+};
+
+struct simEvent {
+    long long time;
+    struct probe probe;
+};
+
+struct simLimit {
+    unsigned int block;
+    double tokens;
+    long long last;
+};
+
+static struct simRule defaultRule = { { 0, 4294967295u }, 0, 0.1, 0.2, 100, 50, 0.01, 0 };
+
+static struct simRule * rules = NULL;
+static unsigned int rulesLen = 0;
+
+static struct simEvent * heap = NULL;
+static unsigned int heapLen = 0;
+
+static struct simLimit * limits = NULL;
+
+/* Virtual clock, us */
+static long long simNow = 0;
+
+static unsigned long long probesCount = 0, openCount = 0, closedCount = 0, timeoutCount = 0;
+static long long startTime = 0;
+
+static double uniform(unsigned long long a, unsigned long long b, unsigned int salt) {
+    unsigned long long x = mix64(mix64(mix64(options.seed ^ ((unsigned long long) salt << 32)) ^ a) ^ b);
+
+    return (x >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static const struct simRule * findRule(unsigned int ip) {
+    const struct simRule * ret = & defaultRule;
+
+    for (unsigned int i = 0; i < rulesLen; ++i) {
+        if (
+            ip >= rules[i].range[0] &&
+            (ip < rules[i].range[1] || rules[i].range[1] == 4294967295u) &&
+            rules[i].prefix >= ret->prefix
+        ) {
+            ret = & rules[i];
+        }
+    }
+
+    return ret;
+}
+
+static bool takeLimit(const struct simRule * rule, unsigned int ip) {
+    if (rule->limit == 0) {
+        return true;
+    }
+
+    unsigned int block = ip >> 8;
+    struct simLimit * limit = & limits[(block * 2654435761u) % SIM_LIMITS];
+
+    if (limit->block != block || limit->last == 0) {
+        limit->block = block;
+        limit->tokens = rule->limit;
+        limit->last = simNow;
+    }
+
+    limit->tokens += (double) rule->limit * (simNow - limit->last) / 1000000;
+    if (limit->tokens > rule->limit) {
+        limit->tokens = rule->limit;
+    }
+
+    limit->last = simNow;
+
+    if (limit->tokens < 1) {
+        return false;
+    }
+
+    limit->tokens -= 1;
+    return true;
+}
+
+static void heapPush(struct simEvent * event) {
+    unsigned int i = heapLen++;
+
+    while (i > 0 && heap[(i - 1) / 2].time > event->time) {
+        heap[i] = heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+
+    heap[i] = * event;
+}
+
+static void heapPop(struct simEvent * event) {
+    * event = heap[0];
+
+    struct simEvent last = heap[--heapLen];
+    unsigned int i = 0;
+
+    for (;;) {
+        unsigned int child = i * 2 + 1;
+
+        if (child >= heapLen) {
+            break;
+        }
+
+        if (child + 1 < heapLen && heap[child + 1].time < heap[child].time) {
+            ++child;
+        }
+
+        if (heap[child].time >= last.time) {
+            break;
+        }
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = last;
+}
+
+static void loadRules(const char * path) {
+    FILE * file = fopen(path, "r");
+    if (file == NULL) {
+        perror("ERROR (sim-config)");
+        exit(1);
+    }
+
+    static char line[256], block[32];
+    unsigned int lineNum = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        ++lineNum;
+
+        if (line[strspn(line, " \t\r\n")] == '\0' || line[strspn(line, " \t")] == '#') {
+            continue;
+        }
+
+        static struct simRule rule;
+        rule.limit = 0;
+
+        int n = sscanf(line, "%31s %lf %lf %lf %lf %lf %u",
+            block, & rule.live, & rule.open, & rule.rtt, & rule.jitter, & rule.loss, & rule.limit);
+
+        const char * end = block + strlen(block);
+        if (n < 6 || ipRangeParse(block, end, rule.range) != end) {
+            fprintf(stderr, "ERROR: Invalid simulator rule on line %u\n", lineNum);
+            exit(1);
+        }
+
+        const char * slash = strchr(block, '/');
+        rule.prefix = slash != NULL ? (unsigned int) atoi(slash + 1) : 32;
+
+        if (rule.prefix == 0) {
+            defaultRule = rule;
+            continue;
+        }
+
+        rules = realloc(rules, (rulesLen + 1) * sizeof(struct simRule));
+        if (rules == NULL) {
+            __error("realloc");
+        }
+
+        rules[rulesLen++] = rule;
+    }
+
+    fclose(file);
+}
+
+static unsigned int simInit(unsigned int maxInFlight) {
+    heap = calloc(maxInFlight, sizeof(struct simEvent));
+    limits = calloc(SIM_LIMITS, sizeof(struct simLimit));
+
+    if (heap == NULL || limits == NULL) {
+        __error("calloc");
+    }
+
+    if (options.simConfig != NULL) {
+        loadRules(options.simConfig);
+    }
+
+    startTime = nowMs();
+    return maxInFlight;
+}
+
+static void simSubmit(unsigned int tag, unsigned int ip, unsigned short port, unsigned int timeout) {
+    const struct simRule * rule = findRule(ip);
+
+    static struct simEvent event;
+    event.probe.tag = tag;
+    event.probe.ip = ip;
+    event.probe.port = port;
+
+    double rtt = rule->rtt - rule->jitter * log(1 - uniform(probesCount, ip, 3));
+
+    if (
+        uniform(ip, 0, 0) >= rule->live ||
+        uniform(probesCount, ip, 1) < rule->loss ||
+        !takeLimit(rule, ip) ||
+        rtt >= timeout
+    ) {
+        event.probe.status = PROBE_TIMEOUT;
+        event.time = simNow + timeout * 1000LL;
+        ++timeoutCount;
+    } else {
+        bool open = uniform(ip, port, 2) < rule->open;
+
+        event.probe.status = open ? PROBE_OPEN : PROBE_CLOSED;
+        event.time = simNow + (long long) (rtt * 1000);
+
+        if (open) {
+            ++openCount;
+        } else {
+            ++closedCount;
+        }
+    }
+
+    ++probesCount;
+    heapPush(& event);
+}
+
+static int simPoll(
+    struct pollfd * extra, unsigned int extraLen, int timeout,
+    struct probe * done, unsigned int * doneLen
+) {
+    * doneLen = 0;
+
+    int ret = 0;
+    if (extraLen > 0) {
+        ret = poll(extra, extraLen, heapLen > 0 ? 0 : timeout);
+
+        if (ret == -1) {
+            if (errno == EINTR) {
+                return -1;
+            }
+
+            __error("poll");
+        }
+    }
+
+    if (heapLen == 0) {
+        if (timeout > 0 && extraLen == 0) {
+            simNow += timeout * 1000LL;
+        }
+
+        return ret;
+    }
+
+    if (timeout >= 0 && heap[0].time > simNow + timeout * 1000LL) {
+        simNow += timeout * 1000LL;
+        return ret;
+    }
+
+    if (heap[0].time > simNow) {
+        simNow = heap[0].time;
+    }
+
+    static struct simEvent event;
+    while (heapLen > 0 && heap[0].time <= simNow) {
+        heapPop(& event);
+        done[(* doneLen)++] = event.probe;
+    }
+
+    return ret + * doneLen;
+}
+
+static long long simClock(void) {
+    return simNow / 1000;
+}
+
+static void simReport(void) {
+    double real = (nowMs() - startTime) / 1000.0;
+
+    fprintf(stderr,
+        "Simulated %llu probes (%llu open, %llu closed, %llu timed out) "
+        "in %.3f s of virtual time, %.3f s real, %.0f probes/s\n",
+        probesCount, openCount, closedCount, timeoutCount,
+        simNow / 1e6, real, real > 0 ? probesCount / real : 0
+    );
+}
+
+const struct backend simBackend = {
+    "sim",
+    simInit,
+    simSubmit,
+    simPoll,
+    simClock,
+    simReport,
+    NULL
+};
+
+#endif
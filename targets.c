@@ -0,0 +1,337 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "targets.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "platform.h"
+
+#include "options.h"
+#include "global.h"
+#include "util.h"
+
+static const char * findLineEnd(const char * str, const char * end) {
+#ifdef __SSE2__
+
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while (end - str >= 16) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *) str), newline));
+
+        if (mask != 0) {
+            return str + __builtin_ctz(mask);
+        }
+
+        str += 16;
+    }
+
+#endif
+
+    const char * ptr = memchr(str, '\n', end - str);
+    return ptr != NULL ? ptr : end;
+}
+
+static const char * skipSpaces(const char * str, const char * end) {
+    while (str != end && (* str == ' ' || * str == '\t' || * str == '\r')) {
+        ++str;
+    }
+
+    return str;
+}
+
+void targetsInit(struct targets * targets, const char * data, size_t len) {
+    targets->data = data;
+    targets->len = len;
+    targets->pos = 0;
+    targets->line = 0;
+    targets->mapped = false;
+
+    targets->range[0] = targets->range[1] = 0;
+    targets->nextIP = 0;
+    targets->list = true;
+
+    targets->sampleIdx = targets->sampleLen = 0;
+    targets->sampleKey = 0;
+    targets->sampleBits = 0;
+    targets->sample = false;
+}
+
+bool targetsOpen(struct targets * targets, const char * path) {
+    targetsInit(targets, NULL, 0);
+
+#ifndef _WIN32
+
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return false;
+    }
+
+    static struct stat st;
+    if (fstat(fd, & st) == -1) {
+        close(fd);
+        return false;
+    }
+
+    if (st.st_size > 0) {
+        void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        posix_madvise(data, st.st_size, POSIX_MADV_SEQUENTIAL);
+
+        targetsInit(targets, data, st.st_size);
+        targets->mapped = true;
+    }
+
+    close(fd);
+
+#else
+
+    FILE * file = fopen(path, "rb");
+    if (file == NULL) {
+        return false;
+    }
+
+    size_t cap = 0, len = 0;
+    char * data = NULL;
+
+    for (;;) {
+        if (len == cap) {
+            cap = cap == 0 ? 65536 : cap * 2;
+
+            data = realloc(data, cap);
+            if (data == NULL) {
+                fclose(file);
+                return false;
+            }
+        }
+
+        size_t r = fread(data + len, 1, cap - len, file);
+        if (r == 0) {
+            break;
+        }
+
+        len += r;
+    }
+
+    fclose(file);
+    targetsInit(targets, data, len);
+
+#endif
+
+    return true;
+}
+
+bool targetsNext(struct targets * targets, unsigned int * range) {
+    const char * end = targets->data + targets->len;
+
+    while (targets->pos < targets->len) {
+        const char * str = targets->data + targets->pos;
+        const char * eol = findLineEnd(str, end);
+
+        targets->pos = eol - targets->data + (eol != end);
+        ++targets->line;
+
+        str = skipSpaces(str, eol);
+        if (str == eol || * str == '#') {
+            continue;
+        }
+
+        const char * ptr = ipRangeParse(str, eol, range);
+        if (ptr != NULL) {
+            ptr = skipSpaces(ptr, eol);
+        }
+
+        if (ptr == NULL || (ptr != eol && * ptr != '#')) {
+            fprintf(stderr, "ERROR: Invalid target on line %u\n", targets->line);
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+bool targetsNext6(struct targets * targets, struct ip6 * ip) {
+    const char * end = targets->data + targets->len;
+
+    while (targets->pos < targets->len) {
+        const char * str = targets->data + targets->pos;
+        const char * eol = findLineEnd(str, end);
+
+        targets->pos = eol - targets->data + (eol != end);
+        ++targets->line;
+
+        str = skipSpaces(str, eol);
+        if (str == eol || * str == '#') {
+            continue;
+        }
+
+        const char * ptr = ip6Parse(str, eol, ip);
+        if (ptr != NULL) {
+            ptr = skipSpaces(ptr, eol);
+        }
+
+        if (ptr == NULL || (ptr != eol && * ptr != '#')) {
+            fprintf(stderr, "ERROR: Invalid target on line %u\n", targets->line);
+            continue;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+void targetsClose(struct targets * targets) {
+#ifndef _WIN32
+
+    if (targets->mapped) {
+        munmap((void *) targets->data, targets->len);
+    }
+
+#else
+
+    free((void *) targets->data);
+
+#endif
+
+    targetsInit(targets, NULL, 0);
+}
+
+bool targetsOpenOptions(struct targets * targets) {
+    if (options.targets != NULL) {
+        return targetsOpen(targets, options.targets);
+    }
+
+    targetsRange(targets, options.ipRange[0], options.ipRange[1]);
+    return true;
+}
+
+void targetsRange(struct targets * targets, unsigned int begin, unsigned int end) {
+    targetsInit(targets, NULL, 0);
+
+    targets->list = false;
+    targets->range[0] = targets->nextIP = begin;
+    targets->range[1] = end;
+}
+
+/* Feistel network over sampleBits bits, walking the cycle until it falls into the range */
+static unsigned long long permute(struct targets * targets, unsigned long long x) {
+    unsigned int half = targets->sampleBits / 2;
+    unsigned long long mask = (1ull << half) - 1;
+    unsigned long long size = (unsigned long long) targets->range[1] - targets->range[0];
+
+    do {
+        unsigned long long left = x >> half, right = x & mask;
+
+        for (register unsigned int round = 0; round < 4; ++round) {
+            unsigned long long next = left ^ (mix64(right ^ (targets->sampleKey + round)) & mask);
+
+            left = right;
+            right = next;
+        }
+
+        x = (left << half) | right;
+    } while (x >= size);
+
+    return x;
+}
+
+static unsigned long long unpermute(struct targets * targets, unsigned long long x) {
+    unsigned int half = targets->sampleBits / 2;
+    unsigned long long mask = (1ull << half) - 1;
+    unsigned long long size = (unsigned long long) targets->range[1] - targets->range[0];
+
+    do {
+        unsigned long long left = x >> half, right = x & mask;
+
+        for (register int round = 3; round >= 0; --round) {
+            unsigned long long prev = right ^ (mix64(left ^ (targets->sampleKey + round)) & mask);
+
+            right = left;
+            left = prev;
+        }
+
+        x = (left << half) | right;
+    } while (x >= size);
+
+    return x;
+}
+
+void targetsSample(struct targets * targets, unsigned int begin, unsigned int end, unsigned long long count, unsigned int seed) {
+    targetsRange(targets, begin, end);
+
+    unsigned long long size = end > begin ? (unsigned long long) end - begin : 0;
+
+    targets->sample = true;
+    targets->sampleLen = count < size ? count : size;
+    targets->sampleKey = mix64(seed);
+
+    targets->sampleBits = 2;
+    while ((1ull << targets->sampleBits) < size) {
+        targets->sampleBits += 2;
+    }
+}
+
+unsigned long long targetsSampleIndex(struct targets * targets, unsigned int ip) {
+    return unpermute(targets, ip - targets->range[0]);
+}
+
+bool targetsNextIP(struct targets * targets, unsigned int * ip) {
+    if (targets->sample) {
+        if (targets->sampleIdx >= targets->sampleLen) {
+            return false;
+        }
+
+        * ip = targets->range[0] + (unsigned int) permute(targets, targets->sampleIdx++);
+        return true;
+    }
+
+    while (targets->nextIP >= targets->range[1]) {
+        if (!targets->list || !targetsNext(targets, targets->range)) {
+            return false;
+        }
+
+        targets->nextIP = targets->range[0];
+    }
+
+    * ip = targets->nextIP++;
+    return true;
+}
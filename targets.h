@@ -0,0 +1,68 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#pragma once
+
+#include <stddef.h>
+
+#include "bool.h"
+
+struct ip6;
+
+/* Streaming parser of a targets list: one IP or CIDR block per line, "#" starts a comment */
+struct targets {
+    const char * data;
+    size_t len;
+    size_t pos;
+
+    unsigned int line;
+    bool mapped;
+
+    /* Address iteration state, see targetsNextIP() */
+    unsigned int range[2];
+    unsigned int nextIP;
+    bool list;
+
+    /* Random sample of the range, see targetsSample() */
+    unsigned long long sampleIdx, sampleLen;
+    unsigned long long sampleKey;
+    unsigned int sampleBits;
+    bool sample;
+};
+
+extern bool targetsOpen(struct targets * targets, const char * path);
+extern void targetsInit(struct targets * targets, const char * data, size_t len);
+extern bool targetsNext(struct targets * targets, unsigned int * range);
+
+/* Reads the next IPv6 address of a hitlist, one per line */
+extern bool targetsNext6(struct targets * targets, struct ip6 * ip);
+extern void targetsClose(struct targets * targets);
+
+/* Iterates over the addresses of the file opened by targetsOpen() or of options range otherwise */
+extern bool targetsOpenOptions(struct targets * targets);
+extern void targetsRange(struct targets * targets, unsigned int begin, unsigned int end);
+extern bool targetsNextIP(struct targets * targets, unsigned int * ip);
+
+/* Iterates over count addresses of the range in a random order given by seed, without repeats */
+extern void targetsSample(struct targets * targets, unsigned int begin, unsigned int end, unsigned long long count, unsigned int seed);
+extern unsigned long long targetsSampleIndex(struct targets * targets, unsigned int ip);
@@ -0,0 +1,205 @@
+#!/bin/sh
+
+# MIT License
+#
+# Copyright (c) 2018 Eridan Domoratskiy
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Regression checks run by "make check": scans of a simulated network compared with
+# the expected output, UPDATE=1 rewrites the expected output with the actual one,
+# and loopback scans of small responders started by responder.py.
+
+export LC_ALL=C
+
+BIN=${1:-./ipscanner}
+DIR=$(dirname "$0")
+TMP=$(mktemp -d)
+
+pids=
+
+trap 'kill $pids 2> /dev/null; rm -rf "$TMP"' EXIT
+
+failed=0
+
+# Compares the actual output with the expected one
+check() {
+    if diff -u "$2" "$3" > "$TMP/diff"; then
+        echo "PASS: $1"
+    else
+        echo "FAIL: $1"
+        cat "$TMP/diff"
+        [ -n "$UPDATE" ] && cp "$3" "$2"
+        failed=1
+    fi
+}
+
+# Simulated network, the probe counts and every hit of a fixed seed
+"$BIN" -B sim -C "$DIR/sim.cfg" -E 7 -p 80 443 22 -R 1 -A 8 -o "$TMP/sim.out" \
+    -- 10.0.0.0 10.0.4.0 > "$TMP/sim.stdout" 2> "$TMP/sim.stderr"
+
+{
+    sed -n 's/^Simulated \([0-9]* probes ([^)]*)\).*/\1/p' "$TMP/sim.stderr"
+    sort "$TMP/sim.stdout"
+    sort "$TMP/sim.out"
+} > "$TMP/sim.txt"
+
+check "simulated scan" "$DIR/sim.expected" "$TMP/sim.txt"
+
+# The same scan with probes capped per block and per host, which has to find the same
+# hosts, only the open port reported first for a host and the probe counts may change
+"$BIN" -B sim -C "$DIR/sim.cfg" -E 7 -p 80 443 22 -R 1 -A 8 -K 4 -H 1 -o "$TMP/caps.out" \
+    -- 10.0.0.0 10.0.4.0 > /dev/null 2> "$TMP/caps.stderr"
+
+sed -n 's/^Simulated \([0-9]* probes ([^)]*)\).* in \([0-9.]* s\) of virtual time.*/\1 in \2/p' \
+    "$TMP/caps.stderr" > "$TMP/caps.txt"
+
+check "capped scan" "$DIR/caps.expected" "$TMP/caps.txt"
+
+sed 's/:.*//' "$TMP/sim.out" | sort > "$TMP/sim.hosts"
+sed 's/:.*//' "$TMP/caps.out" | sort > "$TMP/caps.hosts"
+
+check "capped scan hits" "$TMP/sim.hosts" "$TMP/caps.hosts"
+
+# Estimates of a sample and of a census, which has to collapse to the observed counts
+for args in "-p 80 443 -f 0.5 -L 23 -- 10.0.0.0 10.0.4.0" "-p 80 -f 1 -- 10.0.0.0 10.0.2.0"; do
+    "$BIN" -B sim -C "$DIR/sim.cfg" -E 7 $args 2> /dev/null | sed -n '/^Final/,$p' | grep -v '^IP'
+done > "$TMP/sample.txt"
+
+check "simulated sampling" "$DIR/sample.expected" "$TMP/sample.txt"
+
+# Targets and hitlist files with malformed lines, which are reported and skipped
+{
+    "$BIN" -B sim -C "$DIR/sim.cfg" -E 7 -b -d 1 -p 80 -t "$DIR/targets.txt" 2> "$TMP/targets.err" | sort
+    grep '^ERROR' "$TMP/targets.err"
+    "$BIN" -6 -d 1 -p 1 -t "$DIR/hitlist.txt" 2>&1 > /dev/null | grep '^ERROR\|^Hitlist'
+} > "$TMP/targets.out"
+
+check "targets parser" "$DIR/targets.expected" "$TMP/targets.out"
+
+# Starts a responder and waits for its port in $TMP/<name>.port, fails if it couldn't bind the address
+respond() {
+    python3 "$DIR/responder.py" "$1" "$2" "$TMP/$3.port" > /dev/null 2>&1 &
+    pids="$pids $!"
+
+    for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+        if [ -s "$TMP/$3.port" ]; then
+            return 0
+        fi
+
+        sleep 0.1
+    done
+
+    return 1
+}
+
+if ! command -v python3 > /dev/null; then
+    echo "SKIP: loopback scans, no python3"
+    exit $failed
+fi
+
+# UDP echo on 127.0.0.2, ICMP port unreachable from its neighbours
+if respond udp 127.0.0.2 udp; then
+    port=$(cat "$TMP/udp.port")
+    "$BIN" -u -b -d 1 -p "$port" -- 127.0.0.1 127.0.0.4 2> /dev/null | sort > "$TMP/udp.txt"
+
+    cat > "$TMP/udp.expected" << END
+IP 127.0.0.1 hasn't been responsed on port $port. (closed)
+IP 127.0.0.2 has been responsed on port $port. (yay!!!)
+IP 127.0.0.3 hasn't been responsed on port $port. (closed)
+END
+
+    check "UDP scan" "$TMP/udp.expected" "$TMP/udp.txt"
+else
+    echo "FAIL: UDP responder"
+    failed=1
+fi
+
+# Hits annotated with names of a stub resolver
+if respond tcp 127.0.0.1 tcp && respond ptr 127.0.0.1 ptr; then
+    port=$(cat "$TMP/tcp.port")
+    "$BIN" -d 1 -p "$port" -N "127.0.0.1:$(cat "$TMP/ptr.port")" -o "$TMP/ptr.out" -- 127.0.0.1 127.0.0.3 2> /dev/null > "$TMP/ptr.txt"
+    cat "$TMP/ptr.out" >> "$TMP/ptr.txt"
+
+    cat > "$TMP/ptr.expected" << END
+IP 127.0.0.1 (host-127-0-0-1.test) has been responsed on port $port. (yay!!!)
+127.0.0.1:$port host-127-0-0-1.test
+END
+
+    check "resolved scan" "$TMP/ptr.expected" "$TMP/ptr.txt"
+else
+    echo "FAIL: TCP and PTR responders"
+    failed=1
+fi
+
+# IPv6 hitlist with a repeated address, skipped if ::1 can't be bound
+if respond tcp ::1 tcp6; then
+    port=$(cat "$TMP/tcp6.port")
+    printf '# loopback\n::1\n0:0::1 # again\n' > "$TMP/hitlist.txt"
+    "$BIN" -6 -t "$TMP/hitlist.txt" -d 1 -p "$port" -o "$TMP/ipv6.out" 2> "$TMP/ipv6.err" > "$TMP/ipv6.txt"
+    grep '^Hitlist' "$TMP/ipv6.err" >> "$TMP/ipv6.txt"
+    cat "$TMP/ipv6.out" >> "$TMP/ipv6.txt"
+
+    cat > "$TMP/ipv6.expected" << END
+IP ::1 has been responsed on port $port. (yay!!!)
+Hitlist: 1 addresses, 1 repeated skipped
+[::1]:$port
+END
+
+    check "IPv6 scan" "$TMP/ipv6.expected" "$TMP/ipv6.txt"
+else
+    echo "SKIP: IPv6 scan, no ::1"
+fi
+
+# Two jobs submitted at once to a daemon on the simulated network, then a malformed job line
+"$BIN" -B sim -C "$DIR/sim.cfg" -E 7 -S "$TMP/daemon.sock" > /dev/null 2>&1 &
+pids="$pids $!"
+
+for i in 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20; do
+    if [ -S "$TMP/daemon.sock" ]; then
+        break
+    fi
+
+    sleep 0.1
+done
+
+"$BIN" -s "$TMP/daemon.sock" -d 1 -p 80 443 -- 10.0.0.0 10.0.2.0 > "$TMP/job1.out" 2>&1 &
+job1=$!
+"$BIN" -s "$TMP/daemon.sock" -d 1 -b -p 22 -- 10.0.1.224 10.0.2.32 > "$TMP/job2.out" 2>&1 &
+job2=$!
+
+wait $job1
+echo "job 1 exit $?" > "$TMP/daemon.txt"
+sort "$TMP/job1.out" >> "$TMP/daemon.txt"
+
+wait $job2
+echo "job 2 exit $?" >> "$TMP/daemon.txt"
+sort "$TMP/job2.out" >> "$TMP/daemon.txt"
+
+python3 -c '
+import socket, sys
+sock = socket.socket(socket.AF_UNIX)
+sock.connect(sys.argv[1])
+sock.sendall(b"SCAN 10.0.0.0 10.0.0.4 1 1 0 0\n")
+print(sock.makefile().read(), end="")
+' "$TMP/daemon.sock" >> "$TMP/daemon.txt"
+
+check "daemon jobs" "$DIR/daemon.expected" "$TMP/daemon.txt"
+
+exit $failed
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+
+# MIT License
+#
+# Copyright (c) 2018 Eridan Domoratskiy
+#
+# Permission is hereby granted, free of charge, to any person obtaining a copy
+# of this software and associated documentation files (the "Software"), to deal
+# in the Software without restriction, including without limitation the rights
+# to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+# copies of the Software, and to permit persons to whom the Software is
+# furnished to do so, subject to the following conditions:
+#
+# The above copyright notice and this permission notice shall be included in all
+# copies or substantial portions of the Software.
+#
+# THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+# IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+# FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+# AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+# LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+# OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+# SOFTWARE.
+
+# Loopback responders of tests/check.sh: "responder.py <mode> <address> <port file>" binds
+# a free port of the address, writes it to the port file and serves until it's killed.
+#   udp  echoes datagrams back
+#   tcp  accepts connections and closes them
+#   ptr  answers PTR queries of 127.0.0.1 with host-127-0-0-1.test, NXDOMAIN otherwise
+
+import os
+import socket
+import struct
+import sys
+
+
+def serveUdp(sock):
+    while True:
+        data, addr = sock.recvfrom(1500)
+        sock.sendto(data, addr)
+
+
+def serveTcp(sock):
+    sock.listen(64)
+
+    while True:
+        sock.accept()[0].close()
+
+
+def serveDns(sock):
+    while True:
+        query, addr = sock.recvfrom(512)
+
+        # Question name as labels, then its type and class
+        labels, pos = [], 12
+        while query[pos] != 0:
+            labels.append(query[pos + 1:pos + 1 + query[pos]].decode())
+            pos += query[pos] + 1
+
+        question = query[12:pos + 5]
+        octets = labels[3::-1]
+
+        if labels[4:] == ['in-addr', 'arpa'] and octets == ['127', '0', '0', '1']:
+            name = b''.join(bytes([len(label)]) + label.encode() for label in ['host-' + '-'.join(octets), 'test'])
+            answer = b'\xc0\x0c\x00\x0c\x00\x01\x00\x00\x00\x3c' + struct.pack('>H', len(name) + 1) + name + b'\x00'
+            header = query[:2] + b'\x81\x80' + struct.pack('>HHHH', 1, 1, 0, 0)
+        else:
+            answer = b''
+            header = query[:2] + b'\x81\x83' + struct.pack('>HHHH', 1, 0, 0, 0)
+
+        sock.sendto(header + question + answer, addr)
+
+
+def main():
+    mode, address, portFile = sys.argv[1:4]
+
+    family = socket.AF_INET6 if ':' in address else socket.AF_INET
+    sock = socket.socket(family, socket.SOCK_STREAM if mode == 'tcp' else socket.SOCK_DGRAM)
+    sock.bind((address, 0))
+
+    with open(portFile + '.tmp', 'w') as file:
+        file.write('%d\n' % sock.getsockname()[1])
+
+    os.rename(portFile + '.tmp', portFile)
+
+    {'udp': serveUdp, 'tcp': serveTcp, 'ptr': serveDns}[mode](sock)
+
+
+if __name__ == '__main__':
+    main()
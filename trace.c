@@ -0,0 +1,102 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef TRACE
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include <time.h>
+
+#include "global.h"
+
+struct tracePhaseTime {
+    unsigned long long calls;
+    long long wall, cpu;
+    long long wallStart, cpuStart;
+};
+
+static const char * phaseNames[TRACE_PHASES] = {
+    "socket/fcntl", "connect", "poll wait", "getsockopt", "close", "output"
+};
+
+static struct tracePhaseTime phases[TRACE_PHASES];
+static long long wallStart, cpuStart;
+
+static long long clockNs(clockid_t clock) {
+    static struct timespec ts;
+    clock_gettime(clock, & ts);
+
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void traceInit(void) {
+    wallStart = clockNs(CLOCK_MONOTONIC);
+    cpuStart = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void traceBegin(enum tracePhase phase) {
+    phases[phase].wallStart = clockNs(CLOCK_MONOTONIC);
+    phases[phase].cpuStart = clockNs(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void traceEnd(enum tracePhase phase) {
+    struct tracePhaseTime * time = & phases[phase];
+
+    ++time->calls;
+    time->wall += clockNs(CLOCK_MONOTONIC) - time->wallStart;
+    time->cpu += clockNs(CLOCK_PROCESS_CPUTIME_ID) - time->cpuStart;
+}
+
+void traceReport(void) {
+    long long wall = clockNs(CLOCK_MONOTONIC) - wallStart;
+    long long cpu = clockNs(CLOCK_PROCESS_CPUTIME_ID) - cpuStart;
+    long long restWall = wall, restCpu = cpu;
+
+    fprintf(stderr, "%-14s %12s %12s %7s %12s %7s %10s\n", "Phase", "Calls", "Wall, sec", "Wall", "CPU, sec", "CPU", "Avg, us");
+
+    for (unsigned int i = 0; i < TRACE_PHASES; ++i) {
+        struct tracePhaseTime * time = & phases[i];
+
+        fprintf(
+            stderr, "%-14s %12llu %12.3f %6.1f%% %12.3f %6.1f%% %10.2f\n", phaseNames[i], time->calls,
+            time->wall / 1e9, wall > 0 ? 100.0 * time->wall / wall : 0.0,
+            time->cpu / 1e9, cpu > 0 ? 100.0 * time->cpu / cpu : 0.0,
+            time->calls > 0 ? time->wall / 1e3 / time->calls : 0.0
+        );
+
+        restWall -= time->wall;
+        restCpu -= time->cpu;
+    }
+
+    fprintf(
+        stderr, "%-14s %12s %12.3f %6.1f%% %12.3f %6.1f%%\n", "other", "",
+        restWall / 1e9, wall > 0 ? 100.0 * restWall / wall : 0.0,
+        restCpu / 1e9, cpu > 0 ? 100.0 * restCpu / cpu : 0.0
+    );
+
+    fprintf(stderr, "%-14s %12s %12.3f %7s %12.3f\n", "total", "", wall / 1e9, "", cpu / 1e9);
+}
+
+#endif
@@ -0,0 +1,71 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#pragma once
+
+/* Probe lifecycle instrumentation, built with "make TRACE=1" and compiled out otherwise.
+   USDT probes "ipscanner:phase__begin" and "ipscanner:phase__end" get the phase, IP and port,
+   "ipscanner:probe__done" gets IP, port and status; they are emitted when <sys/sdt.h> is available. */
+enum tracePhase {
+    TRACE_SOCKET,
+    TRACE_CONNECT,
+    TRACE_POLL,
+    TRACE_GETSOCKOPT,
+    TRACE_CLOSE,
+    TRACE_OUTPUT,
+    TRACE_PHASES
+};
+
+#ifdef TRACE
+
+#if defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define TRACE_USDT
+#endif
+#endif
+
+#ifdef TRACE_USDT
+#define TRACE_PROBE(_name, _a, _b, _c) DTRACE_PROBE3(ipscanner, _name, _a, _b, _c)
+#else
+#define TRACE_PROBE(_name, _a, _b, _c)
+#endif
+
+#define TRACE_BEGIN(_phase, _ip, _port) { TRACE_PROBE(phase__begin, _phase, _ip, _port); traceBegin(_phase); }
+#define TRACE_END(_phase, _ip, _port) { traceEnd(_phase); TRACE_PROBE(phase__end, _phase, _ip, _port); }
+#define TRACE_DONE(_ip, _port, _status) TRACE_PROBE(probe__done, _ip, _port, _status)
+
+extern void traceInit(void);
+extern void traceBegin(enum tracePhase phase);
+extern void traceEnd(enum tracePhase phase);
+
+/* Prints wall and CPU time of the run by phase */
+extern void traceReport(void);
+
+#else
+
+#define TRACE_BEGIN(_phase, _ip, _port)
+#define TRACE_END(_phase, _ip, _port)
+#define TRACE_DONE(_ip, _port, _status)
+
+#endif
@@ -0,0 +1,472 @@
+/* MIT License
+
+Copyright (c) 2018 Eridan Domoratskiy
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE. */
+
+
+#ifdef __linux__
+
+#define _GNU_SOURCE
+
+#include "udp.h"
+
+#include <netinet/in.h>
+#include <time.h>
+#include <linux/errqueue.h>
+#include <poll.h>
+
+#include "platform.h"
+
+#include "ratelimit.h"
+#include "resolve.h"
+#include "targets.h"
+#include "options.h"
+#include "global.h"
+#include "main.h"
+#include "util.h"
+
+#define UDP_SOCKETS 4
+#define UDP_BATCH 64
+
+#define PAYLOAD(_port, _data) { _port, sizeof(_data) - 1, _data }
+
+struct udpPayload {
+    unsigned short port;
+    unsigned short len;
+    const char * data;
+};
+
+static const struct udpPayload payloads[] = {
+    /* DNS: version.bind CH TXT */
+    PAYLOAD(53, "\x00\x06\x01\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+        "\x07" "version" "\x04" "bind" "\x00\x00\x10\x00\x03"),
+
+    /* NTP: version 4 client request */
+    PAYLOAD(123, "\xe3\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"
+        "\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00"),
+
+    /* NetBIOS: node status request */
+    PAYLOAD(137, "\x80\xf0\x00\x00\x00\x01\x00\x00\x00\x00\x00\x00"
+        "\x20" "CKAAAAAAAAAAAAAAAAAAAAAAAAAAAAAA" "\x00\x00\x21\x00\x01"),
+
+    /* SNMP: v1 get-request of sysDescr.0 with "public" community */
+    PAYLOAD(161, "\x30\x26\x02\x01\x00\x04\x06" "public"
+        "\xa0\x19\x02\x01\x01\x02\x01\x00\x02\x01\x00\x30\x0e\x30\x0c"
+        "\x06\x08\x2b\x06\x01\x02\x01\x01\x01\x00\x05\x00"),
+
+    /* SSDP: discovery of all services */
+    PAYLOAD(1900, "M-SEARCH * HTTP/1.1\r\n"
+        "HOST: 239.255.255.250:1900\r\n"
+        "MAN: \"ssdp:discover\"\r\n"
+        "MX: 1\r\n"
+        "ST: ssdp:all\r\n\r\n"),
+
+    /* memcached: "stats" with UDP frame header */
+    PAYLOAD(11211, "\x00\x01\x00\x00\x00\x01\x00\x00" "stats\r\n")
+};
+
+static const struct udpPayload emptyPayload = { 0, 0, "" };
+
+enum udpStatus {
+    UDP_WAITING,
+    UDP_OPEN,
+    UDP_CLOSED,
+    UDP_FILTERED
+};
+
+struct udpProbe {
+    long long deadline;
+    unsigned int ip;
+    unsigned short port;
+    unsigned char status;
+};
+
+/* Probes in sending order and an open addressing index of the waiting ones by address */
+static struct udpProbe * ring = NULL;
+static unsigned int ringCap = 0, ringHead = 0, ringLen = 0;
+
+static unsigned int * table = NULL;
+static unsigned int tableMask = 0;
+
+static const struct udpPayload * findPayload(unsigned short port) {
+    for (unsigned int i = 0; i < sizeof(payloads) / sizeof(payloads[0]); ++i) {
+        if (payloads[i].port == port) {
+            return & payloads[i];
+        }
+    }
+
+    return & emptyPayload;
+}
+
+static unsigned int hashProbe(unsigned int ip, unsigned short port) {
+    return ((ip * 2654435761u) ^ (port * 40503u)) & tableMask;
+}
+
+static unsigned int tableFind(unsigned int ip, unsigned short port) {
+    for (unsigned int i = hashProbe(ip, port); table[i] != 0; i = (i + 1) & tableMask) {
+        struct udpProbe * probe = & ring[table[i] - 1];
+
+        if (probe->ip == ip && probe->port == port) {
+            return i;
+        }
+    }
+
+    return tableMask + 1;
+}
+
+/* Finds the entry of a probe itself, repeated targets have several waiting probes of one address */
+static unsigned int tableFindProbe(unsigned int idx) {
+    for (unsigned int i = hashProbe(ring[idx].ip, ring[idx].port); table[i] != 0; i = (i + 1) & tableMask) {
+        if (table[i] == idx + 1) {
+            return i;
+        }
+    }
+
+    return tableMask + 1;
+}
+
+static void tableInsert(unsigned int idx) {
+    unsigned int i = hashProbe(ring[idx].ip, ring[idx].port);
+
+    while (table[i] != 0) {
+        i = (i + 1) & tableMask;
+    }
+
+    table[i] = idx + 1;
+}
+
+static unsigned int probeHome(const void * entry, void * ctx) {
+    unsigned int idx = * (const unsigned int *) entry;
+
+    return idx != 0 ? hashProbe(ring[idx - 1].ip, ring[idx - 1].port) : TABLE_EMPTY;
+}
+
+static void tableRemove(unsigned int i) {
+    tableRemoveAt(table, sizeof(unsigned int), tableMask, i, probeHome, NULL);
+}
+
+static void reportProbe(struct udpProbe * probe) {
+    static const char * statuses[] = { "open|filtered", "open", "closed", "filtered" };
+
+    if (probe->status == UDP_OPEN) {
+        printHit(probe->ip, probe->port);
+        return;
+    }
+
+    if (options.printBoo || options.debug) {
+        static char strIP[16];
+        ipNumToStr(probe->ip, strIP);
+
+        printf("IP %s hasn't been responsed on port %hu. (%s)\n", strIP, probe->port, statuses[probe->status]);
+    }
+}
+
+static void resolveProbe(struct sockaddr_in * addr, enum udpStatus status) {
+    unsigned int ip = ntohl(addr->sin_addr.s_addr);
+    unsigned short port = ntohs(addr->sin_port);
+
+    unsigned int i = tableFind(ip, port);
+    if (i > tableMask) {
+        return;
+    }
+
+    struct udpProbe * probe = & ring[table[i] - 1];
+    probe->status = status;
+
+    tableRemove(i);
+    reportProbe(probe);
+}
+
+static void expireProbes(long long now) {
+    while (ringLen > 0) {
+        struct udpProbe * probe = & ring[ringHead];
+
+        if (probe->status == UDP_WAITING) {
+            if (probe->deadline > now) {
+                return;
+            }
+
+            unsigned int i = tableFindProbe(ringHead);
+            if (i <= tableMask) {
+                tableRemove(i);
+            }
+
+            reportProbe(probe);
+        }
+
+        ringHead = (ringHead + 1) % ringCap;
+        --ringLen;
+    }
+}
+
+static void receiveReplies(int sock) {
+    static struct mmsghdr msgs[UDP_BATCH];
+    static struct iovec iovs[UDP_BATCH];
+    static struct sockaddr_in addrs[UDP_BATCH];
+    static char bufs[UDP_BATCH][512];
+
+    for (;;) {
+        for (unsigned int i = 0; i < UDP_BATCH; ++i) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = sizeof(bufs[i]);
+
+            memset(& msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_name = & addrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+            msgs[i].msg_hdr.msg_iov = & iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int r = recvmmsg(sock, msgs, UDP_BATCH, MSG_DONTWAIT, NULL);
+
+        if (r <= 0) {
+            break;
+        }
+
+        for (int i = 0; i < r; ++i) {
+            resolveProbe(& addrs[i], UDP_OPEN);
+        }
+    }
+
+    for (;;) {
+        static struct sockaddr_in addr;
+        static char buf[512], control[512];
+
+        static struct iovec iov;
+        iov.iov_base = buf;
+        iov.iov_len = sizeof(buf);
+
+        static struct msghdr msg;
+        memset(& msg, 0, sizeof(msg));
+        msg.msg_name = & addr;
+        msg.msg_namelen = sizeof(addr);
+        msg.msg_iov = & iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        if (recvmsg(sock, & msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1) {
+            break;
+        }
+
+        for (struct cmsghdr * cmsg = CMSG_FIRSTHDR(& msg); cmsg != NULL; cmsg = CMSG_NXTHDR(& msg, cmsg)) {
+            if (cmsg->cmsg_level != IPPROTO_IP || cmsg->cmsg_type != IP_RECVERR) {
+                continue;
+            }
+
+            struct sock_extended_err * err = (struct sock_extended_err *) CMSG_DATA(cmsg);
+
+            if (err->ee_origin != SO_EE_ORIGIN_ICMP || err->ee_type != 3) {
+                continue;
+            }
+
+            resolveProbe(& addr, err->ee_code == 3 ? UDP_CLOSED : UDP_FILTERED);
+        }
+    }
+}
+
+int udpScan(void) {
+    static struct targets targets;
+    if (!targetsOpenOptions(& targets)) {
+        perror("ERROR (targets)");
+        return 1;
+    }
+
+    ringCap = options.concurrency;
+    ring = calloc(ringCap, sizeof(struct udpProbe));
+
+    tableMask = 1;
+    while (tableMask < ringCap * 2) {
+        tableMask <<= 1;
+    }
+
+    table = calloc(tableMask, sizeof(unsigned int));
+    --tableMask;
+
+    if (ring == NULL || table == NULL) {
+        __error("calloc");
+    }
+
+    /* The resolver socket follows the probe ones */
+    static struct pollfd socks[UDP_SOCKETS + 1];
+    for (unsigned int i = 0; i < UDP_SOCKETS; ++i) {
+        socks[i].fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (socks[i].fd == -1) {
+            __error("socket");
+        }
+
+        if (setSocketNonBlock(socks[i].fd) == -1) {
+            __error("setSocketNonBlock");
+        }
+
+        static int on = 1;
+        if (setsockopt(socks[i].fd, IPPROTO_IP, IP_RECVERR, & on, sizeof(on)) == -1) {
+            __error("setsockopt");
+        }
+    }
+
+    static struct rateLimit limit;
+    rateLimitInit(& limit, options.rate, nowMs);
+
+    static struct mmsghdr msgs[UDP_BATCH];
+    static struct iovec iovs[UDP_BATCH];
+    static struct sockaddr_in addrs[UDP_BATCH];
+    unsigned int batchLen = 0, sock = 0;
+
+    unsigned int ip = 0, portIdx = options.portsLen;
+    bool more = options.portsLen > 0;
+
+    while (more || batchLen > 0 || ringLen > 0) {
+        while (more && batchLen < UDP_BATCH && ringLen + batchLen < ringCap) {
+            if (portIdx == options.portsLen) {
+                if (!targetsNextIP(& targets, & ip)) {
+                    more = false;
+                    break;
+                }
+
+                portIdx = 0;
+            }
+
+            unsigned short port = options.ports[portIdx++];
+            const struct udpPayload * payload = findPayload(port);
+
+            memset(& addrs[batchLen], 0, sizeof(addrs[batchLen]));
+            addrs[batchLen].sin_family = AF_INET;
+            addrs[batchLen].sin_port = htons(port);
+            ipNumToAddr(ip, & addrs[batchLen].sin_addr);
+
+            iovs[batchLen].iov_base = (void *) payload->data;
+            iovs[batchLen].iov_len = payload->len;
+
+            memset(& msgs[batchLen], 0, sizeof(msgs[batchLen]));
+            msgs[batchLen].msg_hdr.msg_name = & addrs[batchLen];
+            msgs[batchLen].msg_hdr.msg_namelen = sizeof(addrs[batchLen]);
+            msgs[batchLen].msg_hdr.msg_iov = & iovs[batchLen];
+            msgs[batchLen].msg_hdr.msg_iovlen = 1;
+
+            ++batchLen;
+        }
+
+        unsigned int allowed = rateLimitTake(& limit, batchLen);
+
+        if (allowed > 0) {
+            int sent = sendmmsg(socks[sock].fd, msgs, allowed, 0);
+            sock = (sock + 1) % UDP_SOCKETS;
+
+            if (sent == -1) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS) {
+                    if (options.debug) {
+                        perror("ERROR (sendmmsg)");
+                    }
+
+                    sent = 1;
+                } else {
+                    sent = 0;
+                }
+            } else {
+                long long deadline = nowMs() + options.delay * 1000LL;
+
+                for (int i = 0; i < sent; ++i) {
+                    unsigned int idx = (ringHead + ringLen++) % ringCap;
+
+                    ring[idx].deadline = deadline;
+                    ring[idx].ip = ntohl(addrs[i].sin_addr.s_addr);
+                    ring[idx].port = ntohs(addrs[i].sin_port);
+                    ring[idx].status = UDP_WAITING;
+
+                    tableInsert(idx);
+                }
+            }
+
+            rateLimitReturn(& limit, allowed - sent);
+            batchLen -= sent;
+
+            memmove(msgs, msgs + sent, batchLen * sizeof(msgs[0]));
+            memmove(iovs, iovs + sent, batchLen * sizeof(iovs[0]));
+            memmove(addrs, addrs + sent, batchLen * sizeof(addrs[0]));
+
+            for (unsigned int i = 0; i < batchLen; ++i) {
+                msgs[i].msg_hdr.msg_name = & addrs[i];
+                msgs[i].msg_hdr.msg_iov = & iovs[i];
+            }
+        }
+
+        long long now = nowMs();
+        int timeout = -1;
+
+        if (batchLen > 0 && limit.rate != 0) {
+            timeout = rateLimitWait(& limit);
+        } else if (batchLen == 0 && more && ringLen < ringCap) {
+            timeout = 0;
+        }
+
+        /* Writable sockets would only wake up the wait for tokens */
+        bool writable = batchLen > 0 && timeout <= 0;
+
+        for (unsigned int i = 0; i < UDP_SOCKETS; ++i) {
+            socks[i].events = POLLIN | (writable ? POLLOUT : 0);
+        }
+
+        if (ringLen > 0) {
+            int remaining = ring[ringHead].deadline > now ? (int) (ring[ringHead].deadline - now) : 0;
+
+            if (timeout < 0 || remaining < timeout) {
+                timeout = remaining;
+            }
+        }
+
+        socks[UDP_SOCKETS].fd = -1;
+        socks[UDP_SOCKETS].events = POLLIN;
+
+        if (options.resolve != NULL) {
+            socks[UDP_SOCKETS].fd = resolveFd(& timeout);
+        }
+
+        if (poll(socks, UDP_SOCKETS + 1, timeout) == -1 && errno != EINTR) {
+            __error("poll");
+        }
+
+        for (unsigned int i = 0; i < UDP_SOCKETS; ++i) {
+            if (socks[i].revents != 0) {
+                receiveReplies(socks[i].fd);
+            }
+        }
+
+        expireProbes(nowMs());
+
+        if (options.resolve != NULL) {
+            resolvePoll();
+        }
+    }
+
+    for (unsigned int i = 0; i < UDP_SOCKETS; ++i) {
+        close(socks[i].fd);
+    }
+
+    free(ring);
+    free(table);
+    targetsClose(& targets);
+
+    return 0;
+}
+
+#endif
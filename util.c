@@ -24,6 +24,25 @@ SOFTWARE. */
 
 #include "global.h"
 
+static const char octets[256][4] = {
+    "0", "1", "2", "3", "4", "5", "6", "7", "8", "9", "10", "11", "12", "13", "14", "15",
+    "16", "17", "18", "19", "20", "21", "22", "23", "24", "25", "26", "27", "28", "29", "30", "31",
+    "32", "33", "34", "35", "36", "37", "38", "39", "40", "41", "42", "43", "44", "45", "46", "47",
+    "48", "49", "50", "51", "52", "53", "54", "55", "56", "57", "58", "59", "60", "61", "62", "63",
+    "64", "65", "66", "67", "68", "69", "70", "71", "72", "73", "74", "75", "76", "77", "78", "79",
+    "80", "81", "82", "83", "84", "85", "86", "87", "88", "89", "90", "91", "92", "93", "94", "95",
+    "96", "97", "98", "99", "100", "101", "102", "103", "104", "105", "106", "107", "108", "109", "110", "111",
+    "112", "113", "114", "115", "116", "117", "118", "119", "120", "121", "122", "123", "124", "125", "126", "127",
+    "128", "129", "130", "131", "132", "133", "134", "135", "136", "137", "138", "139", "140", "141", "142", "143",
+    "144", "145", "146", "147", "148", "149", "150", "151", "152", "153", "154", "155", "156", "157", "158", "159",
+    "160", "161", "162", "163", "164", "165", "166", "167", "168", "169", "170", "171", "172", "173", "174", "175",
+    "176", "177", "178", "179", "180", "181", "182", "183", "184", "185", "186", "187", "188", "189", "190", "191",
+    "192", "193", "194", "195", "196", "197", "198", "199", "200", "201", "202", "203", "204", "205", "206", "207",
+    "208", "209", "210", "211", "212", "213", "214", "215", "216", "217", "218", "219", "220", "221", "222", "223",
+    "224", "225", "226", "227", "228", "229", "230", "231", "232", "233", "234", "235", "236", "237", "238", "239",
+    "240", "241", "242", "243", "244", "245", "246", "247", "248", "249", "250", "251", "252", "253", "254", "255"
+};
+
 int strchri(const char * haystack, char needle) {
     static char * ptr;
     ptr = strchr(haystack, needle);
@@ -57,28 +76,342 @@ void ipNumToAddr(unsigned int ip, struct in_addr * dst) {
     memcpy(dst, addr, 4);
 }
 
-void ipNumToStr(unsigned int ip, char * dst) {
-    sprintf(dst, "%u.%u.%u.%u",
-        (ip >> 24) & 0xff,
-        (ip >> 16) & 0xff,
-        (ip >> 8) & 0xff,
-        ip & 0xff
-    );
+unsigned int ipNumToStr(unsigned int ip, char * dst) {
+    char * ptr = dst;
+
+    for (register int shift = 24; shift >= 0; shift -= 8) {
+        unsigned int octet = (ip >> shift) & 0xff;
+
+        memcpy(ptr, octets[octet], 4);
+        ptr += 1 + (octet >= 10) + (octet >= 100);
+
+        * ptr++ = '.';
+    }
+
+    * --ptr = '\0';
+    return (unsigned int) (ptr - dst);
+}
+
+const char * ipParse(const char * str, const char * end, unsigned int * ip) {
+    unsigned int ret = 0;
+
+    for (register int i = 0; i < 4; ++i) {
+        if (i > 0) {
+            if (str == end || * str != '.') {
+                return NULL;
+            }
+
+            ++str;
+        }
+
+        unsigned int octet = 0, digits = 0;
+        while (str != end && * str >= '0' && * str <= '9' && digits < 4) {
+            octet = octet * 10 + (* str++ - '0');
+            ++digits;
+        }
+
+        if (digits == 0 || digits > 3 || octet > 255) {
+            return NULL;
+        }
+
+        ret = (ret << 8) | octet;
+    }
+
+    * ip = ret;
+    return str;
+}
+
+const char * ipRangeParse(const char * str, const char * end, unsigned int * range) {
+    unsigned int ip;
+
+    str = ipParse(str, end, & ip);
+    if (str == NULL) {
+        return NULL;
+    }
+
+    if (str == end || * str != '/') {
+        range[0] = ip;
+        range[1] = ip == 4294967295u ? ip : ip + 1;
+        return str;
+    }
+
+    ++str;
+
+    unsigned int prefix = 0, digits = 0;
+    while (str != end && * str >= '0' && * str <= '9' && digits < 3) {
+        prefix = prefix * 10 + (* str++ - '0');
+        ++digits;
+    }
+
+    if (digits == 0 || digits > 2 || prefix > 32) {
+        return NULL;
+    }
+
+    unsigned int mask = prefix == 0 ? 0 : 4294967295u << (32 - prefix);
+
+    range[0] = ip & mask;
+    range[1] = (ip | ~mask) == 4294967295u ? 4294967295u : (ip | ~mask) + 1;
+    return str;
 }
 
 unsigned int ipStrToNum(const char * ip) {
-    static unsigned int ret[4];
+    static unsigned int ret;
+
+    if (ipParse(ip, ip + strlen(ip), & ret) == NULL) {
+        return 0;
+    }
+
+    return ret;
+}
+
+void ip6ToAddr(const struct ip6 * ip, struct in6_addr * dst) {
+    unsigned char addr[16];
+
+    for (register int i = 0; i < 8; ++i) {
+        addr[i] = (ip->hi >> (56 - i * 8)) & 0xff;
+        addr[i + 8] = (ip->lo >> (56 - i * 8)) & 0xff;
+    }
+
+    memcpy(dst, addr, 16);
+}
+
+static unsigned int ip6Group(const struct ip6 * ip, unsigned int i) {
+    return ((i < 4 ? ip->hi : ip->lo) >> (48 - (i % 4) * 16)) & 0xffff;
+}
+
+unsigned int ip6ToStr(const struct ip6 * ip, char * dst) {
+    static const char digits[] = "0123456789abcdef";
+    int zeros = -1, zerosLen = 1;
+
+    if (ip->hi == 0 && ip->lo >> 32 == 0xffff) {
+        memcpy(dst, "::ffff:", 7);
+        return 7 + ipNumToStr(ip->lo & 0xffffffff, dst + 7);
+    }
+
+    /* The first longest run of at least two zero groups is written as "::" */
+    for (int i = 0; i < 8;) {
+        int j = i;
+        while (j < 8 && ip6Group(ip, j) == 0) {
+            ++j;
+        }
+
+        if (j - i > zerosLen) {
+            zeros = i;
+            zerosLen = j - i;
+        }
+
+        i = j > i ? j : i + 1;
+    }
+
+    char * ptr = dst;
+
+    for (int i = 0; i < 8; ++i) {
+        if (i == zeros) {
+            * ptr++ = ':';
+
+            if (i == 0) {
+                * ptr++ = ':';
+            }
+
+            i += zerosLen - 1;
+            continue;
+        }
+
+        unsigned int group = ip6Group(ip, i);
+        bool started = false;
+
+        for (int shift = 12; shift >= 0; shift -= 4) {
+            unsigned int digit = (group >> shift) & 0xf;
+
+            if (digit != 0 || started || shift == 0) {
+                * ptr++ = digits[digit];
+                started = true;
+            }
+        }
+
+        if (i < 7) {
+            * ptr++ = ':';
+        }
+    }
+
+    * ptr = '\0';
+    return (unsigned int) (ptr - dst);
+}
+
+const char * ip6Parse(const char * str, const char * end, struct ip6 * ip) {
+    unsigned int groups[8];
+    int groupsLen = 0, gap = -1;
+
+    if (end - str >= 2 && str[0] == ':' && str[1] == ':') {
+        gap = 0;
+        str += 2;
+    }
+
+    while (groupsLen < 8) {
+        const char * start = str;
+        unsigned int group = 0, digits = 0;
+
+        for (; str != end && digits < 5; ++str, ++digits) {
+            char c = * str | 0x20;
+
+            if (* str >= '0' && * str <= '9') {
+                group = group * 16 + (* str - '0');
+            } else if (c >= 'a' && c <= 'f') {
+                group = group * 16 + (c - 'a' + 10);
+            } else {
+                break;
+            }
+        }
+
+        /* Dotted IPv4 address in the last two groups */
+        if (str != end && * str == '.' && groupsLen <= 6) {
+            unsigned int ip4;
+
+            str = ipParse(start, end, & ip4);
+            if (str == NULL) {
+                return NULL;
+            }
+
+            groups[groupsLen++] = ip4 >> 16;
+            groups[groupsLen++] = ip4 & 0xffff;
+            break;
+        }
+
+        if (digits == 0) {
+            if (groupsLen > 0 && gap != groupsLen) {
+                return NULL;
+            }
+
+            break;
+        }
+
+        if (digits > 4) {
+            return NULL;
+        }
+
+        groups[groupsLen++] = group;
+
+        if (groupsLen == 8 || str == end || * str != ':') {
+            break;
+        }
+
+        if (end - str >= 2 && str[1] == ':') {
+            if (gap != -1) {
+                return NULL;
+            }
+
+            gap = groupsLen;
+            str += 2;
+        } else {
+            ++str;
+        }
+    }
+
+    if (gap == -1 ? groupsLen != 8 : groupsLen > 7) {
+        return NULL;
+    }
+
+    ip->hi = ip->lo = 0;
+
+    for (int i = 0, j = 0; i < 8; ++i) {
+        unsigned long long group = 0;
+
+        if (gap == -1 || i < gap) {
+            group = groups[j++];
+        } else if (i >= gap + 8 - groupsLen) {
+            group = groups[j++];
+        }
+
+        if (i < 4) {
+            ip->hi |= group << (48 - i * 16);
+        } else {
+            ip->lo |= group << (48 - (i - 4) * 16);
+        }
+    }
 
-    sscanf(ip, "%3u.%3u.%3u.%3u",
-        & ret[0],
-        & ret[1],
-        & ret[2],
-        & ret[3]
-    );
+    return str;
+}
+
+unsigned long long mix64(unsigned long long x) {
+    x += 0x9e3779b97f4a7c15ull;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+
+    return x ^ (x >> 31);
+}
+
+void tableRemoveAt(
+    void * entries, size_t size, unsigned int mask, unsigned int i,
+    unsigned int (* home)(const void * entry, void * ctx), void * ctx
+) {
+    char * table = entries;
+
+    memset(table + (size_t) i * size, 0, size);
+
+    for (unsigned int j = i;;) {
+        j = (j + 1) & mask;
+
+        unsigned int k = home(table + (size_t) j * size, ctx);
+
+        if (k == TABLE_EMPTY) {
+            return;
+        }
+
+        if (i <= j ? (i < k && k <= j) : (i < k || k <= j)) {
+            continue;
+        }
+
+        memcpy(table + (size_t) i * size, table + (size_t) j * size, size);
+        memset(table + (size_t) j * size, 0, size);
+        i = j;
+    }
+}
+
+void listAppend(struct list * list, struct listNode * node) {
+    node->list = list;
+    node->prev = list->tail;
+    node->next = NULL;
 
-    ret[0] <<= 24;
-    ret[1] <<= 16;
-    ret[2] <<= 8;
+    if (list->tail != NULL) {
+        list->tail->next = node;
+    } else {
+        list->head = node;
+    }
+
+    list->tail = node;
+    ++list->len;
+}
+
+void listPrepend(struct list * list, struct listNode * node) {
+    node->list = list;
+    node->prev = NULL;
+    node->next = list->head;
+
+    if (list->head != NULL) {
+        list->head->prev = node;
+    } else {
+        list->tail = node;
+    }
+
+    list->head = node;
+    ++list->len;
+}
+
+void listRemove(struct listNode * node) {
+    struct list * list = node->list;
+
+    if (node->prev != NULL) {
+        node->prev->next = node->next;
+    } else {
+        list->head = node->next;
+    }
+
+    if (node->next != NULL) {
+        node->next->prev = node->prev;
+    } else {
+        list->tail = node->prev;
+    }
 
-    return ret[0] + ret[1] + ret[2] + ret[3];
+    node->list = NULL;
+    --list->len;
 }
@@ -22,10 +22,59 @@ SOFTWARE. */
 
 #pragma once
 
+#include <stddef.h>
+
 #include "platform.h"
 
 extern int strchri(const char * haystack, char needle);
 extern int strstri(const char * haystack, const char * needle);
 extern void ipNumToAddr(unsigned int ip, struct in_addr * dst);
-extern void ipNumToStr(unsigned int ip, char * dst);
+extern unsigned int ipNumToStr(unsigned int ip, char * dst);
 extern unsigned int ipStrToNum(const char * ip);
+
+/* Return a pointer past the parsed text or NULL if it isn't valid */
+extern const char * ipParse(const char * str, const char * end, unsigned int * ip);
+extern const char * ipRangeParse(const char * str, const char * end, unsigned int * range);
+
+/* IPv6 address, hi holds the first 8 bytes in host order */
+struct ip6 {
+    unsigned long long hi, lo;
+};
+
+extern void ip6ToAddr(const struct ip6 * ip, struct in6_addr * dst);
+
+/* Formats ip as RFC 5952 text into dst of at least 40 chars, returns its length */
+extern unsigned int ip6ToStr(const struct ip6 * ip, char * dst);
+extern const char * ip6Parse(const char * str, const char * end, struct ip6 * ip);
+
+/* SplitMix64 finalizer, a cheap bijective scrambling of x */
+extern unsigned long long mix64(unsigned long long x);
+
+#define TABLE_EMPTY 0xffffffffu
+
+/* Removes entry i from an open addressing table with linear probing by backward shift deletion,
+   which keeps probe sequences unbroken. home() returns the hashed index of an entry or TABLE_EMPTY,
+   emptied entries are zeroed. */
+extern void tableRemoveAt(
+    void * entries, size_t size, unsigned int mask, unsigned int i,
+    unsigned int (* home)(const void * entry, void * ctx), void * ctx
+);
+
+/* Intrusive doubly linked list, entries embed a listNode and are got back by listEntry() */
+struct list;
+
+struct listNode {
+    struct list * list;
+    struct listNode * prev, * next;
+};
+
+struct list {
+    struct listNode * head, * tail;
+    unsigned int len;
+};
+
+#define listEntry(_node, _type, _member) ((_type *) ((char *) (_node) - offsetof(_type, _member)))
+
+extern void listAppend(struct list * list, struct listNode * node);
+extern void listPrepend(struct list * list, struct listNode * node);
+extern void listRemove(struct listNode * node);